@@ -0,0 +1,232 @@
+// make bench: times the paths a session spends its time in and prints the
+// results as JSON on stdout, one object per benchmark. Inputs come from a
+// fixed seed, so runs on the same machine compare between versions. Each
+// benchmark is sampled BENCH_SAMPLES times and the median is reported.
+#define DEDITOR_NO_MAIN
+#include "main.cpp"
+
+#include <chrono>
+#include <random>
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+const size_t BENCH_SAMPLES = 7;
+const double BENCH_SAMPLE_TIME = 0.05; // seconds, about, for one sample
+const size_t BENCH_FILE_SIZE = 64 << 20;
+
+struct BenchResult{
+  std::string name;
+  size_t iterations; // per sample
+  double seconds;    // median of one iteration
+  double bytes;      // per iteration, 0 if throughput doesn't apply
+};
+std::vector<BenchResult> benchResults;
+
+double benchNow(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs task until one sample takes about BENCH_SAMPLE_TIME, then takes
+// BENCH_SAMPLES of that many runs. A task that's slower than a sample runs
+// once a sample
+void bench(const char* name, double bytes, std::function<void()> task){
+  size_t iterations = 1;
+  while(true){
+    double start = benchNow();
+    for(size_t i = 0; i < iterations; i++) task();
+    double took = benchNow() - start;
+    if(took >= BENCH_SAMPLE_TIME || iterations >= (1u << 30)) break;
+    iterations = took <= 0 ? iterations*16 : std::max(iterations*2, (size_t)(iterations * BENCH_SAMPLE_TIME / took));
+  }
+  std::vector<double> samples;
+  for(size_t s = 0; s < BENCH_SAMPLES; s++){
+    double start = benchNow();
+    for(size_t i = 0; i < iterations; i++) task();
+    samples.push_back((benchNow() - start) / iterations);
+  }
+  std::sort(samples.begin(), samples.end());
+  benchResults.push_back({name, iterations, samples[BENCH_SAMPLES/2], bytes});
+  fprintf(stderr, "%-24s %12.0f ns\n", name, samples[BENCH_SAMPLES/2] * 1e9);
+}
+
+// results can't be thrown away by the optimizer if they end up here
+volatile size_t benchSink;
+
+std::string benchData(size_t size, uint32_t seed){
+  std::mt19937_64 random(seed);
+  std::string data(size, 0);
+  for(size_t i = 0; i+8 <= size; i += 8){
+    uint64_t v = random();
+    memcpy(&data[i], &v, 8);
+  }
+  return data;
+}
+
+void benchLoad(){
+  char path[] = "/tmp/deditor-bench-XXXXXX";
+  int fd = mkstemp(path);
+  std::string data = benchData(BENCH_FILE_SIZE, 1);
+  bool ok = fd >= 0 && write(fd, data.data(), data.size()) == (ssize_t)data.size();
+  if(fd >= 0) close(fd);
+  if(ok){
+    bench("load/readFile", BENCH_FILE_SIZE, [&](){
+      benchSink = readFile(path).size();
+    });
+    // every byte summed, the way readFile has to copy every one of them
+    bench("load/mapped", BENCH_FILE_SIZE, [&](){
+      MappedFile file;
+      file.open(path);
+      uint64_t sum = 0;
+      size_t i = 0;
+      for(; i+8 <= file.size; i += 8){
+        uint64_t v;
+        memcpy(&v, file.data + i, 8);
+        sum += v;
+      }
+      for(; i < file.size; i++) sum += file.data[i];
+      benchSink = sum;
+    });
+    bench("load/File", BENCH_FILE_SIZE, [&](){
+      File file(path);
+      benchSink = file.data.size();
+      storages.clear(); // what File added, nothing else is loaded yet
+    });
+  }
+  else fprintf(stderr, "can't write %s, skipping the load benchmarks\n", path);
+  remove(path);
+}
+
+void benchSearch(){
+  std::string data = benchData(BENCH_FILE_SIZE, 2);
+  std::string pattern = "\xde\xad\xbe\xef";
+  std::vector<size_t> hits;
+  bench("search/findAll", data.size(), [&](){
+    hits.clear();
+    findAll(data.data(), data.size(), 0, pattern, hits);
+    benchSink = hits.size();
+  });
+  const char* p = data.data();
+  size_t n = data.size();
+  std::vector<ByteSource> buffers = {ByteSource{[p, n](size_t offset){ return Span{p, 0, n}; }, n}};
+  std::atomic<uint64_t> done = 0;
+  std::atomic<bool> cancel = false;
+  bench("search/parallel", data.size(), [&](){
+    benchSink = searchBuffers(buffers, pattern, done, cancel).size();
+  });
+  Regex re;
+  re.compile("\\xde\\xad[\\x00-\\x0f]+\\xef");
+  bench("search/regex", data.size(), [&](){
+    size_t count = 0;
+    re.scan([&](size_t offset){ return Span{p, 0, n}; }, 0, n, [&](size_t begin, size_t end){ count++; });
+    benchSink = count;
+  });
+}
+
+// --dump's formatting, on one core and as the command runs it into /dev/null
+void benchDump(){
+  std::string data = benchData(BENCH_FILE_SIZE, 4);
+  DumpFormat format;
+  std::string text;
+  bench("dump/rows", DUMP_CHUNK, [&](){
+    dumpRows((const uint8_t*)data.data(), DUMP_CHUNK, 0, format, text);
+    benchSink = text.size();
+  });
+  FILE* null = fopen("/dev/null", "w");
+  if(!null){
+    fprintf(stderr, "can't open /dev/null, skipping dump/buffer\n");
+    return;
+  }
+  bench("dump/buffer", data.size(), [&](){
+    benchSink = dumpBuffer((const uint8_t*)data.data(), data.size(), 0, format, null);
+  });
+  fclose(null);
+}
+
+// A panel tree laid out the way main lays out files given on the command
+// line: a chain of splits with a leaf on one side of each
+void benchTree(size_t leaves, size_t file){
+  panelTree.clear();
+  panelTree.push_back(Panel{.isSplit = true, .type = 0});
+  for(size_t i = 0; i < leaves-2; i++){
+    panelTree.push_back(Panel{.isSplit = false, .file = {.i = file}});
+    panelTree.push_back(Panel{.isSplit = true, .type = i%2==0});
+  }
+  panelTree.push_back(Panel{.isSplit = false, .file = {.i = file}});
+  panelTree.push_back(Panel{.isSplit = false, .file = {.i = file}});
+}
+
+void benchPanels(){
+  files.push_back(File());
+  benchTree(10000, 0);
+  bench("tree/getSpan", 0, [](){
+    benchSink = getSpan(0);
+  });
+  // parents of panels spread over the whole tree
+  bench("tree/findParent", 0, [](){
+    size_t sum = 0;
+    for(size_t i = 1; i < panelTree.size(); i += panelTree.size()/64) sum += findParent(i);
+    benchSink = sum;
+  });
+}
+
+// Drawing goes to a terminal on /dev/null, all of it stays in curses'
+// screen and nothing is written out
+void benchDraw(){
+  FILE* null = fopen("/dev/null", "w");
+  SCREEN* screen = null ? newterm("xterm-256color", null, stdin) : nullptr;
+  if(!screen){
+    fprintf(stderr, "no xterm-256color terminfo, skipping the draw benchmarks\n");
+    return;
+  }
+  resizeterm(50, 200);
+  init_colors();
+  std::string data = benchData(1 << 20, 3);
+  bench("draw/printHex", 16, [&](){
+    move(0, 0);
+    printHex(data.data(), 16, 4, 8, COLORPAIR_SEL);
+  });
+  bench("draw/printChar", 16, [&](){
+    move(0, 0);
+    printChar(data.data(), 16, 4, 8, COLORPAIR_SEL);
+  });
+
+  files.clear();
+  storages.clear();
+  File file;
+  file.data.init(std::move(data));
+  files.push_back(std::move(file));
+  benchTree(4, 0);
+  ctx.focus = 1;
+  // every row drawn again, as after a key that changes more than a cursor
+  bench("draw/frame", 0, [](){
+    drawnRows.clear();
+    panelTreeDraw(0, 0, 0, COLS, LINES-1);
+  });
+  // only what moved, as after a cursor key
+  bench("draw/frameCached", 0, [](){
+    panelTreeDraw(0, 0, 0, COLS, LINES-1);
+  });
+  endwin();
+  delscreen(screen);
+  fclose(null);
+}
+
+int main(){
+  benchLoad();
+  benchSearch();
+  benchDump();
+  benchPanels();
+  benchDraw();
+
+  printf("{\n  \"version\": \"%s\",\n  \"workers\": %zu,\n  \"benchmarks\": [\n", BENCH_VERSION, workerCount());
+  for(size_t i = 0; i < benchResults.size(); i++){
+    const BenchResult& r = benchResults[i];
+    printf("    {\"name\": \"%s\", \"iterations\": %zu, \"ns\": %.1f", r.name.data(), r.iterations, r.seconds * 1e9);
+    if(r.bytes > 0) printf(", \"mbPerSecond\": %.1f", r.bytes / r.seconds / 1e6);
+    printf("}%s\n", i+1 < benchResults.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <checksum/checksum.hpp>
+#include <diff/diff.hpp>
+#include <readFile/readFile.hpp>
+#include <span/span.hpp>
+
+// BPS patches, the format ROM hackers settled on. After "BPS1" and the sizes
+// of source, target and metadata comes a list of actions that build the
+// target front to back:
+//
+//   SourceRead   bytes of the source at the same offset as the output
+//   TargetRead   bytes stored in the patch
+//   SourceCopy   bytes of the source from anywhere
+//   TargetCopy   bytes of the target written so far, which may overlap
+//                what it's writing to repeat a run
+//
+// Copies give their offset relative to where the last one of their kind
+// ended. The CRC32s of source, target and the patch itself end it.
+
+enum BpsCommand{ BPS_SOURCE_READ, BPS_TARGET_READ, BPS_SOURCE_COPY, BPS_TARGET_COPY };
+
+// 7 bits a byte, the last one has the top bit set. Every byte after the
+// first also stands for one more, so no number has two encodings
+void bpsNumber(std::string& out, uint64_t n){
+  while(true){
+    uint8_t x = n & 0x7f;
+    n >>= 7;
+    if(n == 0){
+      out += (char)(x | 0x80);
+      return;
+    }
+    out += (char)x;
+    n--;
+  }
+}
+
+bool bpsReadNumber(const uint8_t*& p, const uint8_t* end, uint64_t& n){
+  n = 0;
+  uint64_t shift = 1;
+  while(p < end){
+    uint8_t x = *p++;
+    n += (x & 0x7f) * shift;
+    if(x & 0x80) return true;
+    shift <<= 7;
+    n += shift;
+  }
+  return false;
+}
+
+void bpsWrite32(std::string& out, uint32_t v){
+  for(int b = 0; b < 4; b++) out += (char)(v >> b*8);
+}
+
+uint32_t bpsRead32(const uint8_t* p){
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// A patch put together action by action. Reads of the source at the output
+// offset become SourceRead, anything else from the source a SourceCopy
+struct BpsWriter{
+  std::string out;
+  uint64_t output = 0;
+  uint64_t sourceRelative = 0;
+
+  BpsWriter(uint64_t sourceSize, uint64_t targetSize){
+    out = "BPS1";
+    bpsNumber(out, sourceSize);
+    bpsNumber(out, targetSize);
+    bpsNumber(out, 0); // no metadata
+  }
+
+  void source(uint64_t offset, uint64_t length){
+    if(length == 0) return;
+    if(offset == output) bpsNumber(out, (length-1) << 2 | BPS_SOURCE_READ);
+    else{
+      bpsNumber(out, (length-1) << 2 | BPS_SOURCE_COPY);
+      int64_t relative = offset - sourceRelative;
+      bpsNumber(out, (uint64_t)std::abs(relative) << 1 | (relative < 0));
+      sourceRelative = offset + length;
+    }
+    output += length;
+  }
+
+  void target(const char* data, uint64_t length){
+    if(length == 0) return;
+    bpsNumber(out, (length-1) << 2 | BPS_TARGET_READ);
+    out.append(data, length);
+    output += length;
+  }
+
+  // the patch is done after this
+  std::string& finish(uint32_t sourceCrc, uint32_t targetCrc){
+    bpsWrite32(out, sourceCrc);
+    bpsWrite32(out, targetCrc);
+    bpsWrite32(out, ~crc32Update(~0u, (const uint8_t*)out.data(), out.size()));
+    return out;
+  }
+};
+
+struct BpsHeader{
+  uint64_t sourceSize, targetSize;
+  uint32_t sourceCrc, targetCrc;
+  const uint8_t* actions; // up to end
+  const uint8_t* end;
+};
+
+// One action with its offsets made absolute. data points into the patch for
+// a TargetRead
+struct BpsAction{
+  BpsCommand command;
+  uint64_t output;
+  uint64_t length;
+  uint64_t offset; // in the source or the target for copies
+  const uint8_t* data;
+};
+
+// sizes and CRCs, false if it isn't a BPS patch or the patch's CRC is off
+bool bpsHeader(const uint8_t* patch, size_t size, BpsHeader& header, std::string& error){
+  if(size < 4+3+12 || memcmp(patch, "BPS1", 4) != 0){
+    error = "not a BPS patch";
+    return false;
+  }
+  header.end = patch + size - 12;
+  header.sourceCrc = bpsRead32(header.end);
+  header.targetCrc = bpsRead32(header.end+4);
+  const uint8_t* p = patch + 4;
+  uint64_t metadata;
+  if(bpsRead32(header.end+8) != ~crc32Update(~0u, patch, size-4)
+    || !bpsReadNumber(p, header.end, header.sourceSize) || !bpsReadNumber(p, header.end, header.targetSize)
+    || !bpsReadNumber(p, header.end, metadata) || metadata > (uint64_t)(header.end - p)){
+    error = "the patch is damaged";
+    return false;
+  }
+  header.actions = p + metadata;
+  return true;
+}
+
+// Every action is checked against the sizes before it's handed on, so act
+// never sees a copy from outside its buffer. act returns false to stop
+bool bpsActions(const BpsHeader& header, std::function<bool(const BpsAction&)> act, std::string& error){
+  const uint8_t* p = header.actions;
+  const uint8_t* end = header.end;
+  uint64_t output = 0, sourceRelative = 0, targetRelative = 0;
+  while(p < end){
+    uint64_t word, relative;
+    if(!bpsReadNumber(p, end, word)){
+      error = "the patch is damaged";
+      return false;
+    }
+    BpsAction a{(BpsCommand)(word & 3), output, (word >> 2) + 1, 0, nullptr};
+    bool ok = a.length <= header.targetSize - output;
+    if(a.command == BPS_SOURCE_READ){
+      a.offset = output;
+      ok &= output + a.length <= header.sourceSize;
+    }
+    else if(a.command == BPS_TARGET_READ){
+      ok &= a.length <= (uint64_t)(end - p);
+      a.data = p;
+      if(ok) p += a.length;
+    }
+    else{
+      ok &= bpsReadNumber(p, end, relative);
+      uint64_t& from = a.command == BPS_SOURCE_COPY ? sourceRelative : targetRelative;
+      from += relative & 1 ? -(int64_t)(relative >> 1) : (int64_t)(relative >> 1);
+      a.offset = from;
+      from += a.length;
+      if(a.command == BPS_SOURCE_COPY) ok &= a.offset <= header.sourceSize && a.length <= header.sourceSize - a.offset;
+      else ok &= a.offset < output;
+    }
+    if(!ok){
+      error = "the patch is damaged or for another file";
+      return false;
+    }
+    if(!act(a)) return false;
+    output += a.length;
+  }
+  if(output != header.targetSize){
+    error = "the patch ends early";
+    return false;
+  }
+  return true;
+}
+
+uint32_t crc32Of(const uint8_t* p, size_t n){
+  return ~crc32Update(~0u, p, n);
+}
+
+// deditor --mkpatch source target out.bps
+// The patch comes from a diff of the two, equal runs are read from the source
+int runMakePatch(int argc, char** argv){
+  if(argc != 3){
+    fprintf(stderr, "usage: deditor --mkpatch source target out.bps\n");
+    return 2;
+  }
+  MappedFile source, target;
+  if(!source.open(argv[0]) || !target.open(argv[1])){
+    fprintf(stderr, "can't read %s\n", source.size || source.data ? argv[1] : argv[0]);
+    return 1;
+  }
+  auto whole = [](const MappedFile& f){
+    const char* p = (const char*)f.data;
+    size_t n = f.size;
+    return ByteSource{[p, n](size_t offset){ return Span{p, 0, n}; }, n};
+  };
+  DiffResult diff = diffBuffers(whole(source), whole(target));
+  if(diff.truncated){
+    fprintf(stderr, "too many differences for a patch\n");
+    return 1;
+  }
+  BpsWriter writer(source.size, target.size);
+  uint64_t i = 0, j = 0;
+  for(const DiffRange& r: diff.ranges){
+    writer.source(i, r.b - j);
+    writer.target((const char*)target.data + r.b, r.bSize);
+    i = r.a + r.aSize;
+    j = r.b + r.bSize;
+  }
+  // both ends should be equal here, anything left over is stored as is
+  uint64_t tail = std::min(source.size - i, target.size - j);
+  writer.source(i, tail);
+  writer.target((const char*)target.data + j + tail, target.size - j - tail);
+  std::string& patch = writer.finish(crc32Of(source.data, source.size), crc32Of(target.data, target.size));
+
+  FILE* out = fopen(argv[2], "wb");
+  bool ok = out && fwrite(patch.data(), 1, patch.size(), out) == patch.size();
+  if(out) ok &= fclose(out) == 0;
+  if(!ok){
+    fprintf(stderr, "can't write %s\n", argv[2]);
+    return 1;
+  }
+  printf("%zu ranges differ, patch is %zu bytes\n", diff.ranges.size(), patch.size());
+  return 0;
+}
+
+// deditor --patch patch.bps source out
+// The output is mapped at the size the patch gives and written front to
+// back, so the target never has to fit in memory. The source's CRC is worked
+// out on another thread meanwhile, the target's as it's written
+int runApplyPatch(int argc, char** argv){
+  if(argc != 3){
+    fprintf(stderr, "usage: deditor --patch patch.bps source out\n");
+    return 2;
+  }
+  MappedFile patch, source;
+  if(!patch.open(argv[0]) || !source.open(argv[1])){
+    fprintf(stderr, "can't read %s\n", patch.data ? argv[1] : argv[0]);
+    return 1;
+  }
+  BpsHeader header;
+  std::string error;
+  if(!bpsHeader(patch.data, patch.size, header, error)){
+    fprintf(stderr, "%s: %s\n", argv[0], error.data());
+    return 1;
+  }
+  if(header.sourceSize != source.size){
+    fprintf(stderr, "%s: the patch is for a file of %llu bytes\n", argv[0], (unsigned long long)header.sourceSize);
+    return 1;
+  }
+
+  // written next to out and only moved over it once the target's CRC is
+  // right. Either being the source would truncate it while it's read
+  std::string tmp = std::string(argv[2]) + ".tmp";
+  auto isSource = [&](const char* path){
+    struct stat in, out;
+    return stat(path, &out) == 0 && stat(argv[1], &in) == 0 && in.st_dev == out.st_dev && in.st_ino == out.st_ino;
+  };
+  if(isSource(argv[2]) || isSource(tmp.data())){
+    fprintf(stderr, "%s is the source, give another output\n", isSource(argv[2]) ? argv[2] : tmp.data());
+    return 1;
+  }
+  int fd = open(tmp.data(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0 || ftruncate(fd, header.targetSize) != 0){
+    if(fd >= 0){
+      close(fd);
+      remove(tmp.data());
+    }
+    fprintf(stderr, "can't write %s\n", tmp.data());
+    return 1;
+  }
+  uint8_t* target = nullptr;
+  if(header.targetSize > 0){
+    void* mapped = mmap(nullptr, header.targetSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapped == MAP_FAILED){
+      close(fd);
+      remove(tmp.data());
+      fprintf(stderr, "can't map %s\n", tmp.data());
+      return 1;
+    }
+    target = (uint8_t*)mapped;
+  }
+
+  uint32_t sourceCrc;
+  std::thread sourceCheck([&](){ sourceCrc = crc32Of(source.data, source.size); });
+  uint32_t targetCrc = ~0u;
+  bool ok = bpsActions(header, [&](const BpsAction& a){
+    uint8_t* to = target + a.output;
+    if(a.command == BPS_SOURCE_READ || a.command == BPS_SOURCE_COPY) memcpy(to, source.data + a.offset, a.length);
+    else if(a.command == BPS_TARGET_READ) memcpy(to, a.data, a.length);
+    else if(a.offset + a.length <= a.output) memcpy(to, target + a.offset, a.length);
+    else for(uint64_t b = 0; b < a.length; b++) to[b] = target[a.offset + b]; // repeats a run
+    targetCrc = crc32Update(targetCrc, to, a.length);
+    return true;
+  }, error);
+  sourceCheck.join();
+  if(target) munmap(target, header.targetSize);
+  ok &= close(fd) == 0;
+  if(ok && sourceCrc != header.sourceCrc) error = "the patch is for another file";
+  else if(ok && ~targetCrc != header.targetCrc) error = "the patched file came out wrong";
+  if(!ok || !error.empty()){
+    remove(tmp.data());
+    fprintf(stderr, "%s: %s\n", argv[0], error.empty() ? "can't write the output" : error.data());
+    return 1;
+  }
+  if(rename(tmp.data(), argv[2]) != 0){
+    remove(tmp.data());
+    fprintf(stderr, "can't write %s\n", argv[2]);
+    return 1;
+  }
+  return 0;
+}
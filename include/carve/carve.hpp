@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+// Finds where embedded files start by their magic numbers. All signatures
+// are matched in one pass: the two bytes at every offset index a table of
+// which signatures start with them, only those get compared in full.
+
+uint32_t readLE(const uint8_t* p, int bytes){
+  uint32_t v = 0;
+  for(int i = bytes-1; i >= 0; i--) v = v << 8 | p[i];
+  return v;
+}
+
+uint32_t readBE(const uint8_t* p, int bytes){
+  uint32_t v = 0;
+  for(int i = 0; i < bytes; i++) v = v << 8 | p[i];
+  return v;
+}
+
+uint64_t readLE64(const uint8_t* p){
+  return (uint64_t)readLE(p+4, 4) << 32 | readLE(p, 4);
+}
+
+// p is the start of the embedded file, avail the bytes left in the buffer.
+// Returns false if the header doesn't hold up, size is 0 if unknown
+typedef bool (*CarveCheck)(const uint8_t* p, size_t avail, uint64_t& size);
+
+struct Signature{
+  const char* name;
+  std::string_view magic;
+  size_t magicOffset; // where the magic sits inside the header
+  CarveCheck check;
+};
+
+bool checkZip(const uint8_t* p, size_t avail, uint64_t& size){
+  if(avail < 30) return false;
+  uint16_t version = readLE(p+4, 2);
+  uint16_t method = readLE(p+8, 2);
+  uint16_t nameLength = readLE(p+26, 2);
+  bool knownMethod = method <= 9 || method == 12 || method == 14 || method == 93 || method == 95 || method == 98 || method == 99;
+  return version <= 63 && knownMethod && nameLength > 0 && nameLength < 1024;
+}
+
+bool checkElf(const uint8_t* p, size_t avail, uint64_t& size){
+  if(avail < 52) return false;
+  uint8_t elfClass = p[4], order = p[5];
+  if(elfClass < 1 || elfClass > 2 || order < 1 || order > 2 || p[6] != 1) return false;
+  bool wide = elfClass == 2;
+  if(wide && avail < 64) return false;
+  auto get = [&](size_t at, int bytes) -> uint64_t{
+    if(bytes == 8){
+      return order == 1 ? readLE64(p+at) : (uint64_t)readBE(p+at, 4) << 32 | readBE(p+at+4, 4);
+    }
+    return order == 1 ? readLE(p+at, bytes) : readBE(p+at, bytes);
+  };
+  // the section header table is normally the last thing in the file
+  uint64_t shoff = wide ? get(40, 8) : get(32, 4);
+  uint64_t shentsize = wide ? get(58, 2) : get(46, 2);
+  uint64_t shnum = wide ? get(60, 2) : get(48, 2);
+  if(shoff != 0 && shoff < (1ull << 40)) size = shoff + shentsize*shnum;
+  return true;
+}
+
+bool checkPng(const uint8_t* p, size_t avail, uint64_t& size){
+  if(avail < 33 || readBE(p+8, 4) != 13 || memcmp(p+12, "IHDR", 4) != 0) return false;
+  // walk the chunks to IEND, giving up after a few thousand
+  size_t at = 8;
+  for(int chunk = 0; chunk < 4096 && at+12 <= avail; chunk++){
+    uint32_t length = readBE(p+at, 4);
+    if(length > (1u << 31)) break;
+    if(memcmp(p+at+4, "IEND", 4) == 0){
+      size = at + 12;
+      break;
+    }
+    at += 12 + (size_t)length;
+  }
+  return true;
+}
+
+bool checkGzip(const uint8_t* p, size_t avail, uint64_t& size){
+  return avail >= 10 && p[2] == 8 && (p[3] & 0xe0) == 0;
+}
+
+bool checkSquashfs(const uint8_t* p, size_t avail, uint64_t& size){
+  if(avail < 96) return false;
+  bool le = p[0] == 'h';
+  uint32_t blockSize = le ? readLE(p+12, 4) : readBE(p+12, 4);
+  uint16_t major = le ? readLE(p+28, 2) : readBE(p+28, 2);
+  if(major < 2 || major > 4 || blockSize < 4096 || blockSize > (1 << 20) || (blockSize & (blockSize-1))) return false;
+  if(major == 4 && le) size = readLE64(p+40);
+  return true;
+}
+
+bool checkBzip2(const uint8_t* p, size_t avail, uint64_t& size){
+  return avail >= 10 && p[3] >= '1' && p[3] <= '9' && memcmp(p+4, "1AY&SY", 6) == 0;
+}
+
+bool checkUImage(const uint8_t* p, size_t avail, uint64_t& size){
+  if(avail < 64) return false;
+  size = 64 + (uint64_t)readBE(p+12, 4);
+  return p[28] <= 25 && p[29] <= 25 && p[30] <= 15; // os, arch, type
+}
+
+bool checkTar(const uint8_t* p, size_t avail, uint64_t& size){
+  return avail >= 512 && (memcmp(p+257, "ustar\0", 6) == 0 || memcmp(p+257, "ustar ", 6) == 0);
+}
+
+bool checkAny(const uint8_t* p, size_t avail, uint64_t& size){
+  return true;
+}
+
+using namespace std::string_view_literals;
+
+const Signature signatures[] = {
+  {"zip",      "PK\x03\x04"sv,                    0,   checkZip},
+  {"elf",      "\x7f" "ELF"sv,                    0,   checkElf},
+  {"png",      "\x89PNG\r\n\x1a\n"sv,             0,   checkPng},
+  {"gzip",     "\x1f\x8b\x08"sv,                  0,   checkGzip},
+  {"squashfs", "hsqs"sv,                          0,   checkSquashfs},
+  {"squashfs", "sqsh"sv,                          0,   checkSquashfs},
+  {"xz",       "\xfd" "7zXZ\0"sv,                 0,   checkAny},
+  {"7z",       "7z\xbc\xaf\x27\x1c"sv,            0,   checkAny},
+  {"bzip2",    "BZh"sv,                           0,   checkBzip2},
+  {"jpeg",     "\xff\xd8\xff"sv,                  0,   checkAny},
+  {"pdf",      "%PDF-"sv,                         0,   checkAny},
+  {"uimage",   "\x27\x05\x19\x56"sv,              0,   checkUImage},
+  {"cpio",     "070701"sv,                        0,   checkAny},
+  {"tar",      "ustar"sv,                         257, checkTar},
+  {"cramfs",   "\x45\x3d\xcd\x28"sv,              0,   checkAny},
+  {"ubi",      "UBI#"sv,                          0,   checkAny},
+  {"dtb",      "\xd0\x0d\xfe\xed"sv,              0,   checkAny},
+};
+const size_t signatureCount = sizeof(signatures)/sizeof(signatures[0]);
+
+struct CarveHit{
+  uint64_t offset;
+  uint64_t size; // 0 if the header doesn't say
+  uint16_t signature;
+  bool valid;
+};
+
+const size_t CARVE_CHUNK = 4 << 20;
+// how far past a magic number its header can be checked
+const size_t CARVE_LOOKAHEAD = 1 << 20;
+
+// validate drops every hit whose header doesn't check out, otherwise they
+// are all kept with valid telling which ones did
+std::vector<CarveHit> carve(const ByteSource& source, bool validate){
+  size_t size = source.size;
+  size_t maxMagicOffset = 0;
+  // signatures whose magic starts with the two bytes, as a bitmask
+  std::vector<uint32_t> lookup(65536, 0);
+  for(size_t s = 0; s < signatureCount; s++){
+    const uint8_t* m = (const uint8_t*)signatures[s].magic.data();
+    lookup[m[0] | m[1] << 8] |= 1u << s;
+    maxMagicOffset = std::max(maxMagicOffset, signatures[s].magicOffset);
+  }
+
+  size_t chunks = (size + CARVE_CHUNK-1) / CARVE_CHUNK;
+  std::vector<std::vector<CarveHit>> found(chunks);
+  parallelFor(chunks, [&](size_t c){
+    size_t begin = c*CARVE_CHUNK;
+    size_t end = std::min(size, (c+1)*CARVE_CHUNK);
+    if(end == size && end > 0) end--; // the last byte can't start a magic
+    // the chunk plus room for headers before and after it
+    size_t viewBegin = begin - std::min(begin, maxMagicOffset);
+    size_t viewEnd = std::min(size, end + CARVE_LOOKAHEAD);
+    std::string scratch;
+    const uint8_t* view = (const uint8_t*)source.view(viewBegin, viewEnd-viewBegin, scratch);
+    auto data = [&](size_t i){ return view + (i-viewBegin); };
+    for(size_t i = begin; i < end; i++){
+      const uint8_t* p = data(i);
+      uint32_t candidates = lookup[p[0] | p[1] << 8];
+      while(candidates){
+        int s = __builtin_ctz(candidates);
+        candidates &= candidates-1;
+        const Signature& sig = signatures[s];
+        if(i < sig.magicOffset || viewEnd-i < sig.magic.size()) continue;
+        if(memcmp(p, sig.magic.data(), sig.magic.size()) != 0) continue;
+        size_t start = i - sig.magicOffset;
+        CarveHit hit{start, 0, (uint16_t)s, false};
+        hit.valid = sig.check(data(start), viewEnd-start, hit.size);
+        if(!hit.valid) hit.size = 0;
+        if(hit.valid || !validate) found[c].push_back(hit);
+      }
+    }
+  });
+  std::vector<CarveHit> hits;
+  for(auto& f: found) hits.insert(hits.end(), f.begin(), f.end());
+  // tar hits are reported from before their magic
+  std::stable_sort(hits.begin(), hits.end(), [](const CarveHit& a, const CarveHit& b){
+    return a.offset < b.offset;
+  });
+  return hits;
+}
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+// CRC32 (zlib, PNG), CRC32C (iSCSI, ext4), xxHash64 and SHA-256. The CPU
+// specific versions are compiled with target attributes and picked at run
+// time, the plain C ones are used everywhere else and checked against them.
+
+// --- CRC ---------------------------------------------------------------
+
+const uint32_t CRC32_POLY = 0xedb88320;
+const uint32_t CRC32C_POLY = 0x82f63b78;
+
+struct CrcTable{
+  uint32_t t[256];
+  CrcTable(uint32_t poly){
+    for(uint32_t i = 0; i < 256; i++){
+      uint32_t c = i;
+      for(int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ poly : c >> 1;
+      t[i] = c;
+    }
+  }
+};
+
+// crc is the running value without the final inversion, starting at ~0
+uint32_t crcUpdateTable(uint32_t crc, const uint8_t* p, size_t n, uint32_t poly){
+  static const CrcTable crc32(CRC32_POLY), crc32c(CRC32C_POLY);
+  const uint32_t* t = poly == CRC32_POLY ? crc32.t : crc32c.t;
+  for(size_t i = 0; i < n; i++) crc = t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#ifdef CHECKSUM_X86
+// x times the two halves of k, added to the next 16 bytes
+__attribute__((target("pclmul")))
+__m128i crc32Fold(__m128i x, __m128i k, __m128i next){
+  __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+  __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+// Folds 64 bytes at a time with carry-less multiplies down to 16 and then
+// Barrett reduces to 32 bits, the constants are powers of x mod the CRC32
+// polynomial (the same ones zlib's chromium fork uses). n is at least 64
+// and a multiple of 16
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32Pclmul(uint32_t crc, const uint8_t* p, size_t n){
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+  __m128i x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+  __m128i x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+  __m128i x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  p += 64;
+  n -= 64;
+
+  while(n >= 64){
+    x1 = crc32Fold(x1, k1k2, _mm_loadu_si128((const __m128i*)(p + 0x00)));
+    x2 = crc32Fold(x2, k1k2, _mm_loadu_si128((const __m128i*)(p + 0x10)));
+    x3 = crc32Fold(x3, k1k2, _mm_loadu_si128((const __m128i*)(p + 0x20)));
+    x4 = crc32Fold(x4, k1k2, _mm_loadu_si128((const __m128i*)(p + 0x30)));
+    p += 64;
+    n -= 64;
+  }
+  x1 = crc32Fold(x1, k3k4, x2);
+  x1 = crc32Fold(x1, k3k4, x3);
+  x1 = crc32Fold(x1, k3k4, x4);
+  while(n >= 16){
+    x1 = crc32Fold(x1, k3k4, _mm_loadu_si128((const __m128i*)p));
+    p += 16;
+    n -= 16;
+  }
+
+  // 128 to 64 bits
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), k5, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), poly, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, low32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return _mm_extract_epi32(x1, 1);
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32cSse42(uint32_t crc, const uint8_t* p, size_t n){
+  uint64_t c = crc;
+  for(; n >= 8; p += 8, n -= 8){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  crc = c;
+  for(; n > 0; p++, n--) crc = _mm_crc32_u8(crc, *p);
+  return crc;
+}
+#endif
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* p, size_t n){
+#ifdef CHECKSUM_X86
+  static const bool fast = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+  if(fast && n >= 64){
+    size_t bulk = n & ~(size_t)15;
+    crc = crc32Pclmul(crc, p, bulk);
+    p += bulk;
+    n -= bulk;
+  }
+#endif
+  return crcUpdateTable(crc, p, n, CRC32_POLY);
+}
+
+uint32_t crc32cUpdate(uint32_t crc, const uint8_t* p, size_t n){
+#ifdef CHECKSUM_X86
+  static const bool fast = __builtin_cpu_supports("sse4.2");
+  if(fast) return crc32cSse42(crc, p, n);
+#endif
+  return crcUpdateTable(crc, p, n, CRC32C_POLY);
+}
+
+// a*b modulo the reflected polynomial
+uint32_t crcMultiply(uint32_t a, uint32_t b, uint32_t poly){
+  uint32_t m = 1u << 31, product = 0;
+  while(true){
+    if(a & m){
+      product ^= b;
+      if((a & (m-1)) == 0) break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ poly : b >> 1;
+  }
+  return product;
+}
+
+// CRC of a+b from the CRCs of a and b, the way zlib's crc32_combine does it:
+// crc(a) is moved along by x^(8*lengthB) and added in
+uint32_t crcCombine(uint32_t crcA, uint32_t crcB, uint64_t lengthB, uint32_t poly){
+  uint32_t power = 1u << 31; // x^0
+  uint32_t square = 1u << 30; // x^1, squared every bit of the length in bits
+  for(uint64_t bits = lengthB*8; bits; bits >>= 1){
+    if(bits & 1) power = crcMultiply(square, power, poly);
+    square = crcMultiply(square, square, poly);
+  }
+  return crcMultiply(power, crcA, poly) ^ crcB;
+}
+
+// --- xxHash64 ------------------------------------------------------------
+
+const uint64_t XXH_P1 = 11400714785074694791ull;
+const uint64_t XXH_P2 = 14029467366897019727ull;
+const uint64_t XXH_P3 = 1609587929392839161ull;
+const uint64_t XXH_P4 = 9650029242287828579ull;
+const uint64_t XXH_P5 = 2870177450012600261ull;
+
+uint64_t rotl64(uint64_t x, int r){
+  return x << r | x >> (64-r);
+}
+
+uint64_t read64(const uint8_t* p){
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+struct Xxh64{
+  uint64_t v[4];
+  uint64_t length = 0;
+  uint8_t buffer[32];
+  size_t buffered = 0;
+
+  Xxh64(uint64_t seed = 0){
+    v[0] = seed + XXH_P1 + XXH_P2;
+    v[1] = seed + XXH_P2;
+    v[2] = seed;
+    v[3] = seed - XXH_P1;
+  }
+
+  static uint64_t round(uint64_t acc, uint64_t input){
+    return rotl64(acc + input*XXH_P2, 31) * XXH_P1;
+  }
+
+  void stripe(const uint8_t* p){
+    for(int l = 0; l < 4; l++) v[l] = round(v[l], read64(p + l*8));
+  }
+
+  void update(const uint8_t* p, size_t n){
+    length += n;
+    if(buffered > 0){
+      size_t take = std::min(n, 32 - buffered);
+      memcpy(buffer + buffered, p, take);
+      buffered += take;
+      p += take;
+      n -= take;
+      if(buffered < 32) return;
+      stripe(buffer);
+      buffered = 0;
+    }
+    for(; n >= 32; p += 32, n -= 32) stripe(p);
+    memcpy(buffer, p, n);
+    buffered = n;
+  }
+
+  uint64_t digest(){
+    uint64_t h;
+    if(length >= 32){
+      h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+      for(int l = 0; l < 4; l++) h = (h ^ round(0, v[l])) * XXH_P1 + XXH_P4;
+    }
+    else h = v[2] + XXH_P5;
+    h += length;
+    const uint8_t* p = buffer;
+    size_t n = buffered;
+    for(; n >= 8; p += 8, n -= 8) h = rotl64(h ^ round(0, read64(p)), 27) * XXH_P1 + XXH_P4;
+    if(n >= 4){
+      uint32_t w;
+      memcpy(&w, p, 4);
+      h = rotl64(h ^ (uint64_t)w * XXH_P1, 23) * XXH_P2 + XXH_P3;
+      p += 4;
+      n -= 4;
+    }
+    for(; n > 0; p++, n--) h = rotl64(h ^ *p * XXH_P5, 11) * XXH_P1;
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+  }
+};
+
+// --- SHA-256 -------------------------------------------------------------
+
+const uint32_t SHA256_K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+uint32_t rotr32(uint32_t x, int r){
+  return x >> r | x << (32-r);
+}
+
+void sha256BlocksScalar(uint32_t state[8], const uint8_t* p, size_t blocks){
+  for(; blocks > 0; blocks--, p += 64){
+    uint32_t w[64];
+    for(int i = 0; i < 16; i++) w[i] = (uint32_t)p[i*4] << 24 | p[i*4+1] << 16 | p[i*4+2] << 8 | p[i*4+3];
+    for(int i = 16; i < 64; i++){
+      uint32_t s0 = rotr32(w[i-15], 7) ^ rotr32(w[i-15], 18) ^ w[i-15] >> 3;
+      uint32_t s1 = rotr32(w[i-2], 17) ^ rotr32(w[i-2], 19) ^ w[i-2] >> 10;
+      w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for(int i = 0; i < 64; i++){
+      uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+      uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+#ifdef CHECKSUM_X86
+// The SHA extensions keep the state as ABEF/CDGH and do two rounds per
+// sha256rnds2, msg1/msg2 extend the schedule four words at a time
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256BlocksShaNi(uint32_t state[8], const uint8_t* p, size_t blocks){
+  const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xb1); // CDAB
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1b); // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0); // CDGH
+
+  for(; blocks > 0; blocks--, p += 64){
+    __m128i abefSave = state0, cdghSave = state1;
+    __m128i msg[4];
+    for(int g = 0; g < 16; g++){
+      if(g < 4) msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + g*16)), byteSwap);
+      __m128i m = _mm_add_epi32(msg[g%4], _mm_loadu_si128((const __m128i*)&SHA256_K[g*4]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+      if(g >= 3 && g < 15){
+        __m128i& next = msg[(g+1)%4];
+        next = _mm_add_epi32(next, _mm_alignr_epi8(msg[g%4], msg[(g+3)%4], 4));
+        next = _mm_sha256msg2_epu32(next, msg[g%4]);
+      }
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0e));
+      if(g >= 1 && g < 13) msg[(g+3)%4] = _mm_sha256msg1_epu32(msg[(g+3)%4], msg[g%4]);
+    }
+    state0 = _mm_add_epi32(state0, abefSave);
+    state1 = _mm_add_epi32(state1, cdghSave);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b); // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xb1); // DCHG
+  _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xf0)); // DCBA
+  _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8)); // HGFE
+}
+#endif
+
+struct Sha256{
+  uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  uint64_t length = 0;
+  uint8_t buffer[64];
+  size_t buffered = 0;
+
+  static void blocks(uint32_t state[8], const uint8_t* p, size_t n){
+#ifdef CHECKSUM_X86
+    static const bool fast = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+    if(fast) return sha256BlocksShaNi(state, p, n);
+#endif
+    sha256BlocksScalar(state, p, n);
+  }
+
+  void update(const uint8_t* p, size_t n){
+    length += n;
+    if(buffered > 0){
+      size_t take = std::min(n, 64 - buffered);
+      memcpy(buffer + buffered, p, take);
+      buffered += take;
+      p += take;
+      n -= take;
+      if(buffered < 64) return;
+      blocks(state, buffer, 1);
+      buffered = 0;
+    }
+    blocks(state, p, n/64);
+    p += n/64*64;
+    n %= 64;
+    memcpy(buffer, p, n);
+    buffered = n;
+  }
+
+  void digest(uint8_t out[32]){
+    uint64_t bits = length*8;
+    uint8_t pad[72] = {0x80};
+    size_t padding = (buffered < 56 ? 56 : 120) - buffered;
+    for(int i = 0; i < 8; i++) pad[padding+i] = bits >> (56 - i*8);
+    update(pad, padding+8);
+    for(int i = 0; i < 8; i++){
+      for(int b = 0; b < 4; b++) out[i*4+b] = state[i] >> (24 - b*8);
+    }
+  }
+};
+
+// --- all of them over a range --------------------------------------------
+
+struct Checksums{
+  uint32_t crc32;
+  uint32_t crc32c;
+  uint64_t xxh64;
+  uint8_t sha256[32];
+};
+
+// calls f with every contiguous run of [begin, end), at most step bytes at a time.
+// Stops early and returns false once cancel is set
+bool forEachRun(const ByteSource& source, size_t begin, size_t end, size_t step, const std::atomic<bool>& cancel, std::function<void(const uint8_t*, size_t)> f){
+  while(begin < end){
+    if(cancel) return false;
+    Span s = source.span(begin);
+    size_t n = std::min({s.end, end, begin + step}) - begin;
+    f((const uint8_t*)s.data + (begin - s.begin), n);
+    begin += n;
+  }
+  return true;
+}
+
+const size_t CHECKSUM_CHUNK = 16 << 20;
+
+// The CRCs are worked out for chunks in parallel and combined. xxHash64 and
+// SHA-256 can only go front to back, they each get a thread of their own
+// next to the chunks. done counts bytes over all four, so 4*size at the end
+bool checksumRange(const ByteSource& source, size_t begin, size_t end, Checksums& out, std::atomic<uint64_t>& done, const std::atomic<bool>& cancel, size_t threads = workerCount()){
+  const size_t step = 1 << 20;
+  size_t size = end - begin;
+  size_t chunks = std::max<size_t>((size + CHECKSUM_CHUNK-1) / CHECKSUM_CHUNK, 1);
+  std::vector<uint32_t> crc32s(chunks), crc32cs(chunks);
+  parallelFor(chunks + 2, [&](size_t task){
+    if(task == 0){
+      Sha256 sha;
+      forEachRun(source, begin, end, step, cancel, [&](const uint8_t* p, size_t n){
+        sha.update(p, n);
+        done += n;
+      });
+      sha.digest(out.sha256);
+    }
+    else if(task == 1){
+      Xxh64 xxh;
+      forEachRun(source, begin, end, step, cancel, [&](const uint8_t* p, size_t n){
+        xxh.update(p, n);
+        done += n;
+      });
+      out.xxh64 = xxh.digest();
+    }
+    else{
+      size_t c = task - 2;
+      size_t from = begin + c*CHECKSUM_CHUNK;
+      size_t to = std::min(end, from + CHECKSUM_CHUNK);
+      uint32_t a = ~0u, b = ~0u;
+      forEachRun(source, from, to, step, cancel, [&](const uint8_t* p, size_t n){
+        a = crc32Update(a, p, n);
+        b = crc32cUpdate(b, p, n);
+        done += 2*n;
+      });
+      crc32s[c] = ~a;
+      crc32cs[c] = ~b;
+    }
+  }, threads);
+  if(cancel) return false;
+  out.crc32 = crc32s[0];
+  out.crc32c = crc32cs[0];
+  for(size_t c = 1; c < chunks; c++){
+    size_t length = std::min(end - (begin + c*CHECKSUM_CHUNK), CHECKSUM_CHUNK);
+    out.crc32 = crcCombine(out.crc32, crc32s[c], length, CRC32_POLY);
+    out.crc32c = crcCombine(out.crc32c, crc32cs[c], length, CRC32C_POLY);
+  }
+  return true;
+}
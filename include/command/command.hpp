@@ -0,0 +1,82 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Pieces of the : command line that don't depend on the editor. Arguments
+// are views into the typed line, nothing is copied until a command needs it.
+
+// Splits on spaces. A word starting with " runs to the next " and keeps the
+// quotes, so "two words" stays one argument and patterns can tell text from
+// hex bytes
+std::vector<std::string_view> splitArgs(std::string_view line){
+  std::vector<std::string_view> args;
+  size_t i = 0;
+  while(true){
+    while(i < line.size() && line[i] == ' ') i++;
+    if(i == line.size()) break;
+    size_t end;
+    if(line[i] == '"'){
+      end = line.find('"', i+1);
+      end = end == std::string_view::npos ? line.size() : end+1;
+    }
+    else{
+      end = line.find(' ', i);
+      if(end == std::string_view::npos) end = line.size();
+    }
+    args.push_back(line.substr(i, end-i));
+    i = end;
+  }
+  return args;
+}
+
+// everything from args[i] to the end of the line, for patterns with spaces
+std::string_view argsFrom(const std::vector<std::string_view>& args, size_t i){
+  return std::string_view(args[i].data(), args.back().data() + args.back().size() - args[i].data());
+}
+
+// decimal or 0x hex
+bool parseNumber(std::string_view s, size_t& out){
+  int base = 10;
+  if(s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')){
+    s.remove_prefix(2);
+    base = 16;
+  }
+  uint64_t v;
+  auto [end, error] = std::from_chars(s.data(), s.data() + s.size(), v, base);
+  if(error != std::errc() || end != s.data() + s.size()) return false;
+  out = v;
+  return true;
+}
+
+// Longest completion of word that every candidate starting with it shares.
+// Returns how many candidates there were
+size_t completeWord(std::string_view word, const std::vector<std::string_view>& candidates, std::string& out){
+  size_t found = 0;
+  for(std::string_view c: candidates){
+    if(c.substr(0, word.size()) != word) continue;
+    if(found++ == 0) out = c;
+    else{
+      size_t same = 0;
+      while(same < out.size() && same < c.size() && out[same] == c[same]) same++;
+      out.resize(same);
+    }
+  }
+  if(found == 0) out = word;
+  return found;
+}
+
+// lines entered before, oldest first, without repeats in a row
+struct History{
+  static const size_t LIMIT = 200;
+  std::vector<std::string> lines;
+
+  void add(const std::string& line){
+    if(line.empty() || (!lines.empty() && lines.back() == line)) return;
+    if(lines.size() == LIMIT) lines.erase(lines.begin());
+    lines.push_back(line);
+  }
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+// Differences between two buffers as pairs of ranges. Buffers of the same
+// size are compared byte for byte, in chunks on every core. Otherwise bytes
+// were probably inserted or removed somewhere, and after every difference
+// the two sides are searched for the nearest point where they line up
+// again. Either way only windows of the buffers are looked at and the list
+// stops at DIFF_MAX_RANGES, so memory stays bounded however big they are.
+
+struct DiffRange{
+  uint64_t a, aSize; // in the first buffer
+  uint64_t b, bSize; // what it became in the second
+};
+
+const size_t DIFF_CHUNK = 4 << 20;
+const size_t DIFF_GAP = 8;         // ranges closer than this are one
+const size_t DIFF_MAX_RANGES = 1 << 20;
+const size_t DIFF_SYNC = 32;       // bytes that have to match to line up again
+const size_t DIFF_NEAR = 64;       // substitutions this long are tried first
+const size_t DIFF_HORIZON = 64 << 10; // furthest a resync is looked for
+
+// index of the first i with (a[i] == b[i]) == equal, n if there's none
+size_t findRun(const uint8_t* a, const uint8_t* b, size_t n, bool equal){
+  size_t i = 0;
+#ifdef __SSE2__
+  for(; i+16 <= n; i += 16){
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+i)), _mm_loadu_si128((const __m128i*)(b+i)));
+    uint32_t mask = _mm_movemask_epi8(eq);
+    if(!equal) mask ^= 0xffff;
+    if(mask) return i + __builtin_ctz(mask);
+  }
+#endif
+  for(; i < n; i++) if((a[i] == b[i]) == equal) return i;
+  return n;
+}
+
+struct DiffResult{
+  std::vector<DiffRange> ranges;
+  bool truncated = false;
+
+  void add(DiffRange r){
+    if(!ranges.empty()){
+      DiffRange& last = ranges.back();
+      if(r.a <= last.a + last.aSize + DIFF_GAP && r.b <= last.b + last.bSize + DIFF_GAP){
+        last.aSize = r.a + r.aSize - last.a;
+        last.bSize = r.b + r.bSize - last.b;
+        return;
+      }
+    }
+    if(ranges.size() >= DIFF_MAX_RANGES) truncated = true;
+    else ranges.push_back(r);
+  }
+};
+
+// differing runs of a chunk of two same sized buffers
+void diffChunk(const ByteSource& a, const ByteSource& b, size_t begin, size_t n, std::vector<DiffRange>& out){
+  std::string scratchA, scratchB;
+  const uint8_t* pa = (const uint8_t*)a.view(begin, n, scratchA);
+  const uint8_t* pb = (const uint8_t*)b.view(begin, n, scratchB);
+  size_t i = 0;
+  while(out.size() < DIFF_MAX_RANGES){
+    i += findRun(pa+i, pb+i, n-i, false);
+    if(i == n) break;
+    size_t end = i + findRun(pa+i, pb+i, n-i, true);
+    out.push_back({begin+i, end-i, begin+i, end-i});
+    i = end;
+  }
+}
+
+DiffResult diffAligned(const ByteSource& a, const ByteSource& b){
+  DiffResult result;
+  size_t chunks = (a.size + DIFF_CHUNK-1) / DIFF_CHUNK;
+  // a batch of chunks at a time, so a list that's full stops the rest
+  size_t batch = workerCount();
+  for(size_t first = 0; first < chunks && !result.truncated; first += batch){
+    size_t count = std::min(batch, chunks - first);
+    std::vector<std::vector<DiffRange>> found(count);
+    parallelFor(count, [&](size_t c){
+      size_t begin = (first+c) * DIFF_CHUNK;
+      diffChunk(a, b, begin, std::min(DIFF_CHUNK, a.size - begin), found[c]);
+    });
+    for(auto& ranges: found) for(DiffRange& r: ranges) result.add(r);
+  }
+  return result;
+}
+
+// Where a[x..] and b[y..] line up again with the smallest x+y, looking at
+// the bytes given on each side. Every DIFF_SYNC byte window of b goes into a
+// table by its hash, then the windows of a are looked up in it nearest first
+bool resync(const uint8_t* a, size_t aSize, const uint8_t* b, size_t bSize, size_t& x, size_t& y){
+  if(aSize < DIFF_SYNC || bSize < DIFF_SYNC) return false;
+
+  // the same x and y on both sides first, the usual case of changed bytes
+  for(size_t d = 1; d <= DIFF_NEAR && d + DIFF_SYNC <= std::min(aSize, bSize); d++){
+    if(memcmp(a+d, b+d, DIFF_SYNC) == 0){
+      x = y = d;
+      return true;
+    }
+  }
+
+  const uint32_t BASE = 0x01000193;
+  uint32_t drop = 1; // BASE^DIFF_SYNC, takes the byte leaving the window out
+  for(size_t k = 0; k < DIFF_SYNC; k++) drop *= BASE;
+  // slots from an older call are told apart by their stamp, so the table
+  // never has to be cleared
+  int bits = 2;
+  while(((size_t)1 << bits) < bSize*4) bits++;
+  static thread_local std::vector<uint32_t> stamps, positions;
+  static thread_local uint32_t stamp = 0;
+  if(stamps.size() < ((size_t)1 << bits)){
+    stamps.assign((size_t)1 << bits, 0);
+    positions.resize((size_t)1 << bits);
+  }
+  stamp++;
+  auto slot = [&](uint32_t h){ return (h * 2654435761u) >> (32-bits); };
+
+  size_t bEnd = bSize - DIFF_SYNC;
+  uint32_t h = 0;
+  for(size_t k = 0; k < DIFF_SYNC; k++) h = h*BASE + b[k];
+  for(size_t j = 0;; j++){
+    uint32_t s = slot(h);
+    if(stamps[s] != stamp){
+      stamps[s] = stamp;
+      positions[s] = j;
+    }
+    if(j == bEnd) break;
+    h = h*BASE + b[j+DIFF_SYNC] - drop*b[j];
+  }
+
+  size_t best = SIZE_MAX;
+  size_t aEnd = aSize - DIFF_SYNC;
+  h = 0;
+  for(size_t k = 0; k < DIFF_SYNC; k++) h = h*BASE + a[k];
+  for(size_t i = 0; i < best; i++){
+    uint32_t s = slot(h);
+    if(stamps[s] == stamp){
+      size_t j = positions[s];
+      if(i + j < best && memcmp(a+i, b+j, DIFF_SYNC) == 0){
+        best = i + j;
+        x = i;
+        y = j;
+      }
+    }
+    if(i == aEnd) break;
+    h = h*BASE + a[i+DIFF_SYNC] - drop*a[i];
+  }
+  return best != SIZE_MAX;
+}
+
+DiffResult diffShifted(const ByteSource& a, const ByteSource& b){
+  DiffResult result;
+  std::string scratchA, scratchB;
+  size_t i = 0, j = 0;
+  while(!result.truncated){
+    // equal run, a window at a time
+    while(i < a.size && j < b.size){
+      size_t n = std::min({a.size - i, b.size - j, DIFF_CHUNK});
+      const uint8_t* pa = (const uint8_t*)a.view(i, n, scratchA);
+      const uint8_t* pb = (const uint8_t*)b.view(j, n, scratchB);
+      size_t same = findRun(pa, pb, n, false);
+      i += same;
+      j += same;
+      if(same < n) break;
+    }
+    if(i == a.size || j == b.size){
+      if(i < a.size || j < b.size) result.add({i, a.size - i, j, b.size - j});
+      break;
+    }
+
+    // close by first, most differences are short
+    size_t x, y;
+    bool synced = false;
+    size_t na, nb;
+    for(size_t horizon = 256; !synced && horizon <= DIFF_HORIZON; horizon *= 16){
+      na = std::min(a.size - i, horizon + DIFF_SYNC);
+      nb = std::min(b.size - j, horizon + DIFF_SYNC);
+      const uint8_t* pa = (const uint8_t*)a.view(i, na, scratchA);
+      const uint8_t* pb = (const uint8_t*)b.view(j, nb, scratchB);
+      synced = resync(pa, na, pb, nb, x, y);
+    }
+    if(!synced){
+      // nothing lines up this close, all of it counts as changed
+      x = std::min(na, DIFF_HORIZON);
+      y = std::min(nb, DIFF_HORIZON);
+    }
+    result.add({i, x, j, y});
+    i += x;
+    j += y;
+  }
+  return result;
+}
+
+DiffResult diffBuffers(const ByteSource& a, const ByteSource& b){
+  return a.size == b.size ? diffAligned(a, b) : diffShifted(a, b);
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <parallel/parallel.hpp>
+#include <readFile/readFile.hpp>
+
+// Hex dumps in the format xxd prints them:
+//
+//   00000010: 7320 6973 2061 2074 6573 7420 6f66 2078  s is a test of x
+//
+// Rows don't depend on each other, so a file is cut into chunks of whole
+// rows that are formatted on every core and written out in order. The file
+// is mapped rather than read, nothing is copied before it's formatted.
+
+const size_t DUMP_COLUMNS_MAX = 256;
+const size_t DUMP_CHUNK = 1 << 20; // input bytes per chunk, about
+
+struct DumpFormat{
+  size_t columns = 16;
+  size_t group = 2; // bytes between spaces, 0 for none
+
+  // characters of the hex part of a full row
+  size_t hexWidth() const{
+    size_t g = group == 0 ? columns : group;
+    return columns*2 + (columns-1)/g;
+  }
+
+  // longest a row can be, offsets of up to 16 digits
+  size_t rowMax() const{
+    return 16 + 2 + hexWidth() + 2 + columns + 1;
+  }
+};
+
+// two lowercase hex digits for each of n bytes
+void hexDigits(const uint8_t* p, size_t n, char* out){
+  static const char digits[] = "0123456789abcdef";
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i low = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+  // nibble n becomes '0'+n, plus the gap to 'a' for n > 9
+  auto ascii = [&](__m128i n){
+    return _mm_add_epi8(_mm_add_epi8(n, zero), _mm_and_si128(_mm_cmpgt_epi8(n, nine), letters));
+  };
+  for(; i+16 <= n; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(p+i));
+    __m128i hi = ascii(_mm_and_si128(_mm_srli_epi16(v, 4), low));
+    __m128i lo = ascii(_mm_and_si128(v, low));
+    _mm_storeu_si128((__m128i*)(out + i*2), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i*)(out + i*2 + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+#endif
+  for(; i < n; i++){
+    out[i*2] = digits[p[i] >> 4];
+    out[i*2+1] = digits[p[i] & 0x0f];
+  }
+}
+
+// the text column, . for anything that isn't printable ascii
+void printableChars(const uint8_t* p, size_t n, char* out){
+  size_t i = 0;
+#ifdef __SSE2__
+  // compares are signed, bytes from 0x80 up are negative and fail the first
+  const __m128i space = _mm_set1_epi8(0x1f);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i dot = _mm_set1_epi8('.');
+  for(; i+16 <= n; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(p+i));
+    __m128i shown = _mm_and_si128(_mm_cmpgt_epi8(v, space), _mm_cmplt_epi8(v, del));
+    _mm_storeu_si128((__m128i*)(out+i), _mm_or_si128(_mm_and_si128(shown, v), _mm_andnot_si128(shown, dot)));
+  }
+#endif
+  for(; i < n; i++) out[i] = p[i] >= 0x20 && p[i] < 0x7f ? p[i] : '.';
+}
+
+// hex digits of n bytes in groups of g, each followed by a space. n is a
+// multiple of g, a size known at compile time makes every copy a move
+template<size_t g>
+char* spreadGroups(const char* hex, size_t n, char* out){
+  for(size_t i = 0; i < n; i += g){
+    memcpy(out, hex + i*2, g*2);
+    out[g*2] = ' ';
+    out += g*2 + 1;
+  }
+  return out;
+}
+
+// one row of n <= columns bytes at offset, returns the characters written
+size_t dumpRow(const uint8_t* p, size_t n, uint64_t offset, const DumpFormat& format, char* out){
+  static const char digits[] = "0123456789abcdef";
+  char* start = out;
+  int width = 8;
+  while(width < 16 && offset >> width*4) width++;
+  for(int d = width-1; d >= 0; d--) *out++ = digits[offset >> d*4 & 0xf];
+  *out++ = ':';
+  *out++ = ' ';
+
+  char* hex = out;
+  size_t g = format.group == 0 ? format.columns : format.group;
+  char packed[DUMP_COLUMNS_MAX*2];
+  if(g >= n){
+    hexDigits(p, n, out);
+    out += n*2;
+  }
+  else if(n % g == 0 && (g == 1 || g == 2 || g == 4 || g == 8)){
+    // the usual groupings, the space after the last one is part of the padding
+    hexDigits(p, n, packed);
+    if(g == 1) out = spreadGroups<1>(packed, n, out);
+    else if(g == 2) out = spreadGroups<2>(packed, n, out);
+    else if(g == 4) out = spreadGroups<4>(packed, n, out);
+    else out = spreadGroups<8>(packed, n, out);
+  }
+  else{
+    // digits go in a row and are moved apart group by group from the back
+    hexDigits(p, n, out);
+    size_t groups = (n + g-1) / g;
+    for(size_t k = groups; k-- > 1;){
+      size_t size = std::min(g, n - k*g) * 2;
+      memmove(out + k*g*2 + k, out + k*g*2, size);
+      out[k*g*2 + k - 1] = ' ';
+    }
+    out += n*2 + groups-1;
+  }
+  size_t pad = format.hexWidth() - (out - hex) + 2;
+  memset(out, ' ', pad);
+  out += pad;
+  printableChars(p, n, out);
+  out += n;
+  *out++ = '\n';
+  return out - start;
+}
+
+// rows for n bytes at p, which sit at offset in the file
+void dumpRows(const uint8_t* p, size_t n, uint64_t offset, const DumpFormat& format, std::string& out){
+  size_t rows = (n + format.columns-1) / format.columns;
+  out.resize(rows * format.rowMax() + 16);
+  size_t at = 0;
+  for(size_t r = 0; r < rows; r++){
+    size_t from = r*format.columns;
+    at += dumpRow(p + from, std::min(format.columns, n - from), offset + from, format, &out[at]);
+  }
+  out.resize(at);
+}
+
+// all of data to out, chunks formatted in parallel and written in order
+bool dumpBuffer(const uint8_t* data, size_t size, uint64_t offset, const DumpFormat& format, FILE* out){
+  size_t chunk = std::max<size_t>(1, DUMP_CHUNK / format.columns) * format.columns;
+  size_t chunks = (size + chunk-1) / chunk;
+  // a batch of chunks at a time so memory doesn't grow with the file
+  size_t batch = workerCount() * 2;
+  std::vector<std::string> texts(batch);
+  bool ok = true;
+  for(size_t first = 0; first < chunks && ok; first += batch){
+    size_t count = std::min(batch, chunks - first);
+    std::vector<bool> finished(count, false);
+    size_t written = 0;
+    std::mutex lock;
+    parallelFor(count, [&](size_t c){
+      size_t begin = (first+c) * chunk;
+      dumpRows(data + begin, std::min(chunk, size - begin), offset + begin, format, texts[c]);
+      std::lock_guard<std::mutex> guard(lock);
+      finished[c] = true;
+      for(; written < count && finished[written]; written++){
+        ok &= fwrite(texts[written].data(), 1, texts[written].size(), out) == texts[written].size();
+      }
+    });
+  }
+  return ok;
+}
+
+// deditor --dump [-c columns] [-g group] [-s seek] [-l length] file
+int runDump(int argc, char** argv){
+  DumpFormat format;
+  size_t seek = 0, length = SIZE_MAX;
+  const char* path = nullptr;
+  bool usage = false;
+  for(int a = 0; a < argc && !usage; a++){
+    std::string arg = argv[a];
+    if((arg == "-c" || arg == "-g" || arg == "-s" || arg == "-l") && a+1 < argc){
+      size_t value = strtoull(argv[++a], nullptr, 0);
+      if(arg == "-c") format.columns = value;
+      else if(arg == "-g") format.group = value;
+      else if(arg == "-s") seek = value;
+      else length = value;
+    }
+    else if(!path && arg[0] != '-') path = argv[a];
+    else usage = true;
+  }
+  if(usage || !path || format.columns == 0 || format.columns > DUMP_COLUMNS_MAX){
+    fprintf(stderr, "usage: deditor --dump [-c columns (1-%zu)] [-g group] [-s seek] [-l length] file\n", DUMP_COLUMNS_MAX);
+    return 2;
+  }
+  if(format.group > format.columns) format.group = format.columns;
+
+  MappedFile file;
+  if(!file.open(path)){
+    fprintf(stderr, "can't read %s\n", path);
+    return 1;
+  }
+  seek = std::min(seek, file.size);
+  length = std::min(length, file.size - seek);
+  bool ok = dumpBuffer(file.data + seek, length, seek, format, stdout);
+  ok &= fflush(stdout) == 0;
+  return ok ? 0 : 1;
+}
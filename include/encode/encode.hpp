@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ENCODE_X86 1
+#endif
+
+#include <dump/dump.hpp>
+#include <span/span.hpp>
+
+// Bytes as text to paste into source code: C and Rust arrays, base64 and
+// \x escapes. A range is encoded a chunk at a time into the same buffer and
+// written out before the next, so memory stays at a chunk however big the
+// range is. Chunks are a multiple of a row and of a base64 group, only the
+// last one ends part way through either.
+
+const size_t ENCODE_ROW = 12; // array elements per line, as xxd -i has them
+const size_t ENCODE_CHUNK = ENCODE_ROW << 16;
+
+// array elements, "0x2a, " each and a line break after every row. C gets
+// no comma after the last one, Rust keeps it the way rustfmt does
+void encodeArray(const uint8_t* p, size_t n, bool last, const char* indent, bool trailingComma, std::string& out){
+  std::string hex(n*2, 0);
+  hexDigits(p, n, hex.data());
+  size_t indentSize = strlen(indent);
+  for(size_t row = 0; row < n; row += ENCODE_ROW){
+    size_t count = std::min(ENCODE_ROW, n - row);
+    size_t at = out.size();
+    out.resize(at + indentSize + count*6);
+    char* o = &out[at];
+    memcpy(o, indent, indentSize);
+    o += indentSize;
+    for(size_t i = 0; i < count; i++){
+      o[0] = '0';
+      o[1] = 'x';
+      o[2] = hex[(row+i)*2];
+      o[3] = hex[(row+i)*2+1];
+      o[4] = ',';
+      o[5] = ' ';
+      o += 6;
+    }
+    // the space after the last one becomes the line break
+    o[-1] = '\n';
+    if(last && row + count == n && !trailingComma){
+      o[-2] = '\n';
+      out.pop_back();
+    }
+  }
+}
+
+void encodeC(const uint8_t* p, size_t n, bool last, std::string& out){
+  encodeArray(p, n, last, "  ", false, out);
+}
+
+void encodeRust(const uint8_t* p, size_t n, bool last, std::string& out){
+  encodeArray(p, n, last, "    ", true, out);
+}
+
+// \x2a for every byte, so nothing depends on what the string goes into
+void encodeEscaped(const uint8_t* p, size_t n, bool last, std::string& out){
+  size_t at = out.size();
+  out.resize(at + n*4);
+  char* o = &out[at];
+  std::string hex(n*2, 0);
+  hexDigits(p, n, hex.data());
+  for(size_t i = 0; i < n; i++){
+    o[0] = '\\';
+    o[1] = 'x';
+    o[2] = hex[i*2];
+    o[3] = hex[i*2+1];
+    o += 4;
+  }
+}
+
+const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#ifdef ENCODE_X86
+// 12 bytes to 16 characters a step, the method from Muła and Lemire's
+// "Faster Base64 Encoding and Decoding using AVX2 Instructions". The bytes
+// are spread so every 6 bit index lands in a byte of its own, then the
+// index picks an offset that turns it into its character. Reads 16 bytes
+// for every 12, returns how many it did
+__attribute__((target("ssse3")))
+size_t base64Ssse3(const uint8_t* p, size_t n, char* out){
+  const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i offsets = _mm_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+    '0'-52, '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0);
+  size_t i = 0;
+  for(; i+16 <= n; i += 12){
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p+i)), spread);
+    // every 32 bits hold 3 bytes, move each 6 bits to the bottom of a byte
+    __m128i hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    __m128i index = _mm_or_si128(hi, lo);
+    // 0-25 pick 13, 26-51 pick 0, the digits and +/ 1-12
+    __m128i pick = _mm_subs_epu8(index, _mm_set1_epi8(51));
+    pick = _mm_or_si128(pick, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), index), _mm_set1_epi8(13)));
+    __m128i chars = _mm_add_epi8(index, _mm_shuffle_epi8(offsets, pick));
+    _mm_storeu_si128((__m128i*)(out + i/3*4), chars);
+  }
+  return i;
+}
+#endif
+
+// n is a multiple of 3 except for the last chunk, which gets the padding
+void encodeBase64(const uint8_t* p, size_t n, bool last, std::string& out){
+  size_t at = out.size();
+  out.resize(at + (n+2)/3*4);
+  char* o = &out[at];
+  size_t i = 0;
+#ifdef ENCODE_X86
+  static const bool fast = __builtin_cpu_supports("ssse3");
+  if(fast) i = base64Ssse3(p, n, o);
+#endif
+  for(; i+3 <= n; i += 3){
+    uint32_t v = p[i] << 16 | p[i+1] << 8 | p[i+2];
+    char* c = o + i/3*4;
+    c[0] = base64Alphabet[v >> 18];
+    c[1] = base64Alphabet[v >> 12 & 63];
+    c[2] = base64Alphabet[v >> 6 & 63];
+    c[3] = base64Alphabet[v & 63];
+  }
+  if(i < n){
+    uint32_t v = p[i] << 16 | (i+1 < n ? p[i+1] << 8 : 0);
+    char* c = o + i/3*4;
+    c[0] = base64Alphabet[v >> 18];
+    c[1] = base64Alphabet[v >> 12 & 63];
+    c[2] = i+1 < n ? base64Alphabet[v >> 6 & 63] : '=';
+    c[3] = '=';
+  }
+}
+
+struct Encoding{
+  const char* name;
+  void (*encode)(const uint8_t* p, size_t n, bool last, std::string& out);
+  // before and after the bytes, %s is the array name and %llu the size
+  const char* head;
+  const char* tail;
+};
+
+const Encoding encodings[] = {
+  {"c",       encodeC,       "unsigned char %s[] = {\n", "};\nunsigned int %s_len = %llu;\n"},
+  {"rust",    encodeRust,    "pub static %s: [u8; %llu] = [\n", "];\n"},
+  {"base64",  encodeBase64,  "", "\n"},
+  {"escaped", encodeEscaped, "", "\n"},
+};
+
+const Encoding* findEncoding(std::string_view name){
+  for(const Encoding& e: encodings) if(name == e.name) return &e;
+  return nullptr;
+}
+
+// a file name made into an identifier the way xxd -i does, in capitals for
+// Rust's statics
+std::string arrayName(std::string_view fileName, bool upper){
+  std::string name = fileName.empty() ? "data" : std::string(fileName);
+  for(char& c: name){
+    if(!isalnum((unsigned char)c)) c = '_';
+    else if(upper) c = toupper((unsigned char)c);
+  }
+  if(isdigit((unsigned char)name[0])) name.insert(0, "_");
+  return name;
+}
+
+// head or tail with the name and size put in, the name always comes first
+void encodeFrame(const char* format, const std::string& name, uint64_t size, std::string& out){
+  int n = snprintf(nullptr, 0, format, name.data(), (unsigned long long)size);
+  size_t at = out.size();
+  out.resize(at + n);
+  snprintf(&out[at], n+1, format, name.data(), (unsigned long long)size);
+}
+
+// n bytes of src at begin, encoded and written to out a chunk at a time
+bool encodeRange(const ByteSource& src, size_t begin, size_t n, const Encoding& e, const std::string& name, FILE* out){
+  std::string text, scratch;
+  encodeFrame(e.head, name, n, text);
+  bool ok = true;
+  for(size_t done = 0; done < n && ok; done += ENCODE_CHUNK){
+    size_t count = std::min(ENCODE_CHUNK, n - done);
+    const uint8_t* p = (const uint8_t*)src.view(begin + done, count, scratch);
+    e.encode(p, count, done + count == n, text);
+    ok = fwrite(text.data(), 1, text.size(), out) == text.size();
+    text.clear();
+  }
+  encodeFrame(e.tail, name, n, text);
+  return ok && fwrite(text.data(), 1, text.size(), out) == text.size();
+}
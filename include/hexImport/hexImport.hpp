@@ -0,0 +1,308 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEXIMPORT_X86 1
+#endif
+
+// Hex text back into bytes, either xxd style dumps:
+//
+//   00000010: 7320 6973 2061 2074 6573 7420 6f66 2078  s is a test of x
+//
+// or plain hex with any whitespace in between (xxd -p). Text is read a block
+// at a time and decoded in two passes: the hex digits of 16 characters are
+// picked out of the whitespace around them with a shuffle, then pairs of
+// digits are packed into bytes. Anything that's neither ends the digits, so
+// a dump's text column is never read as hex.
+
+const size_t HEX_BLOCK = 4 << 20;
+
+bool isHexSpace(char c, bool newlines){
+  return c == ' ' || c == '\t' || (newlines && (c == '\n' || c == '\r'));
+}
+
+int hexDigitValue(char c){
+  if(c >= '0' && c <= '9') return c - '0';
+  c |= 0x20;
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+#ifdef HEXIMPORT_X86
+// shuffles that move the bytes picked by an 8 bit mask to the front
+struct CompactTable{
+  alignas(16) uint8_t order[256][16];
+
+  CompactTable(){
+    for(int mask = 0; mask < 256; mask++){
+      int n = 0;
+      for(int b = 0; b < 8; b++) if(mask >> b & 1) order[mask][n++] = b;
+      while(n < 16) order[mask][n++] = 0x80;
+    }
+  }
+};
+
+// Nibbles of the digits in text[0, n) appended to nibbles, stops at the
+// first character that isn't a digit or whitespace, or with spaces (two
+// whitespace in a row) at them. Returns the characters looked at, the rest
+// are left to the scalar loop
+__attribute__((target("ssse3,popcnt")))
+size_t hexNibblesSsse3(const char* text, size_t n, bool newlines, bool spaces, uint8_t* nibbles, size_t& count){
+  static const CompactTable table;
+  const __m128i nine = _mm_set1_epi8('9' + 1);
+  const __m128i zero = _mm_set1_epi8('0' - 1);
+  const __m128i a = _mm_set1_epi8('a' - 1);
+  const __m128i f = _mm_set1_epi8('f' + 1);
+  const __m128i lower = _mm_set1_epi8(0x20);
+  size_t i = 0;
+  for(; i+16 <= n; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(text+i));
+    __m128i l = _mm_or_si128(v, lower);
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, zero), _mm_cmplt_epi8(v, nine));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(l, a), _mm_cmplt_epi8(l, f));
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    if(newlines) space = _mm_or_si128(space, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    uint32_t digits = _mm_movemask_epi8(_mm_or_si128(digit, letter));
+    uint32_t blanks = _mm_movemask_epi8(space);
+    uint32_t stop = ~(digits | blanks) & 0xffff;
+    if(spaces){
+      // the character before this block counts as well
+      bool before = i > 0 && isHexSpace(text[i-1], newlines);
+      stop |= (blanks & (blanks >> 1 | before));
+    }
+    if(stop) break;
+    // '0'..'9' are worth c-'0', letters (c|0x20)-'a'+10
+    __m128i values = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                                  _mm_andnot_si128(digit, _mm_sub_epi8(l, _mm_set1_epi8('a' - 10))));
+    __m128i low = _mm_shuffle_epi8(values, _mm_load_si128((const __m128i*)table.order[digits & 0xff]));
+    __m128i high = _mm_shuffle_epi8(_mm_srli_si128(values, 8), _mm_load_si128((const __m128i*)table.order[digits >> 8]));
+    _mm_storeu_si128((__m128i*)(nibbles+count), low);
+    count += _mm_popcnt_u32(digits & 0xff);
+    _mm_storeu_si128((__m128i*)(nibbles+count), high);
+    count += _mm_popcnt_u32(digits >> 8);
+  }
+  return i;
+}
+#endif
+
+// Same as hexNibblesSsse3 for all of text, returns where it stopped. nibbles
+// needs room for n+16
+size_t hexNibbles(const char* text, size_t n, bool newlines, bool spaces, uint8_t* nibbles, size_t& count){
+  size_t i = 0;
+#ifdef HEXIMPORT_X86
+  static const bool fast = __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt");
+  if(fast) i = hexNibblesSsse3(text, n, newlines, spaces, nibbles, count);
+#endif
+  for(; i < n; i++){
+    int value = hexDigitValue(text[i]);
+    if(value >= 0){
+      nibbles[count++] = value;
+      continue;
+    }
+    if(!isHexSpace(text[i], newlines)) break;
+    if(spaces && i > 0 && isHexSpace(text[i-1], newlines)) break;
+  }
+  return i;
+}
+
+// pairs of nibbles into count/2 bytes, high one first
+size_t packNibbles(const uint8_t* nibbles, size_t count, uint8_t* out){
+  size_t n = count/2;
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i low = _mm_set1_epi16(0xff);
+  for(; i+16 <= n; i += 16){
+    // every 16 bit lane holds the high nibble in its low byte
+    __m128i a = _mm_loadu_si128((const __m128i*)(nibbles + i*2));
+    __m128i b = _mm_loadu_si128((const __m128i*)(nibbles + i*2 + 16));
+    a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, low), 4), _mm_srli_epi16(a, 8));
+    b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, low), 4), _mm_srli_epi16(b, 8));
+    _mm_storeu_si128((__m128i*)(out+i), _mm_packus_epi16(a, b));
+  }
+#endif
+  for(; i < n; i++) out[i] = nibbles[i*2] << 4 | nibbles[i*2+1];
+  return n;
+}
+
+struct DumpLine{
+  uint64_t offset;
+  size_t size;
+};
+
+// Bytes of one line of an xxd dump appended to out, false if it doesn't
+// start with an offset. Digits pair up across single spaces and the hex
+// ends at two spaces in a row, so dumps of any width and grouping work
+bool parseDumpLine(std::string_view line, std::vector<uint8_t>& nibbles, std::string& out, DumpLine& parsed){
+  size_t i = 0;
+  uint64_t offset = 0;
+  for(int value; i < line.size() && (value = hexDigitValue(line[i])) >= 0; i++) offset = offset << 4 | value;
+  if(i == 0 || i == line.size() || line[i] != ':') return false;
+  i++;
+  while(i < line.size() && isHexSpace(line[i], false)) i++;
+  if(nibbles.size() < line.size() + 32) nibbles.resize(line.size() + 32);
+  size_t count = 0;
+  hexNibbles(line.data() + i, line.size() - i, false, true, nibbles.data(), count);
+  size_t at = out.size();
+  out.resize(at + count/2);
+  packNibbles(nibbles.data(), count, (uint8_t*)&out[at]);
+  parsed = {offset, count/2};
+  return true;
+}
+
+// pasted text, a dump or plain hex. Offsets of a dump are ignored, its rows
+// follow each other. Returns false if something in it isn't hex
+bool decodeHexText(std::string_view text, std::string& out){
+  std::vector<uint8_t> nibbles;
+  size_t colon = text.find(':');
+  size_t lineEnd = text.find('\n');
+  bool dump = colon != std::string_view::npos && colon < lineEnd && colon > 0;
+  for(size_t c = 0; dump && c < colon; c++) dump = hexDigitValue(text[c]) >= 0;
+  if(dump){
+    for(size_t at = 0; at < text.size();){
+      size_t end = std::min(text.find('\n', at), text.size());
+      std::string_view line = text.substr(at, end - at);
+      at = end + 1;
+      DumpLine parsed;
+      if(line.find_first_not_of(" \t\r") == std::string_view::npos) continue;
+      if(!parseDumpLine(line, nibbles, out, parsed)) return false;
+    }
+    return true;
+  }
+  nibbles.resize(text.size() + 32);
+  size_t count = 0;
+  size_t stop = hexNibbles(text.data(), text.size(), true, false, nibbles.data(), count);
+  if(stop < text.size() || count % 2) return false;
+  out.resize(count/2);
+  packNibbles(nibbles.data(), count, (uint8_t*)out.data());
+  return true;
+}
+
+// Writes what's decoded to a file, at the offsets a dump gives. A file that
+// can't seek (a pipe) can still be skipped ahead in, with zeros
+struct HexOutput{
+  FILE* file;
+  uint64_t position = 0; // of the next byte, buffered ones included
+  std::string buffer;
+  bool ok = true;
+
+  void flush(){
+    ok &= fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    buffer.clear();
+  }
+
+  bool seek(uint64_t offset, std::string& error){
+    if(offset == position) return true;
+    flush();
+    if(fseeko(file, offset, SEEK_SET) != 0){
+      if(offset < position){
+        error = "can't seek backwards in the output";
+        return false;
+      }
+      buffer.assign(offset - position, 0);
+    }
+    position = offset;
+    return true;
+  }
+
+  void added(size_t n){
+    position += n;
+    if(buffer.size() >= HEX_BLOCK) flush();
+  }
+};
+
+// deditor --undump [-p] [in [out]], - or nothing for stdin/stdout
+int runUndump(int argc, char** argv){
+  bool plain = false;
+  const char* paths[2] = {"-", "-"};
+  int given = 0;
+  for(int a = 0; a < argc; a++){
+    if(strcmp(argv[a], "-p") == 0) plain = true;
+    else if(given < 2) paths[given++] = argv[a];
+    else{
+      fprintf(stderr, "usage: deditor --undump [-p] [in [out]]\n");
+      return 2;
+    }
+  }
+  FILE* in = strcmp(paths[0], "-") == 0 ? stdin : fopen(paths[0], "rb");
+  FILE* out = strcmp(paths[1], "-") == 0 ? stdout : fopen(paths[1], "wb");
+  if(!in || !out){
+    fprintf(stderr, "can't open %s\n", in ? paths[1] : paths[0]);
+    return 1;
+  }
+
+  HexOutput output{out};
+  std::string text(HEX_BLOCK, 0);
+  std::vector<uint8_t> nibbles(plain ? HEX_BLOCK + 32 : 0);
+  std::string error, bytes;
+  size_t kept = 0;       // characters carried over from the last block
+  size_t pending = 0;    // plain: a digit waiting for its pair in nibbles[0]
+  uint64_t line = 1, consumed = 0;
+  while(error.empty()){
+    size_t got = fread(&text[kept], 1, text.size() - kept, in);
+    size_t n = kept + got;
+    bool last = got == 0 || feof(in);
+    if(n == 0) break;
+
+    if(plain){
+      size_t count = pending;
+      size_t stop = hexNibbles(text.data(), n, true, false, nibbles.data(), count);
+      if(stop < n){
+        error = "not hex at byte " + std::to_string(consumed + stop);
+        break;
+      }
+      size_t at = output.buffer.size();
+      output.buffer.resize(at + count/2);
+      output.added(packNibbles(nibbles.data(), count, (uint8_t*)&output.buffer[at]));
+      pending = count % 2;
+      if(pending) nibbles[0] = nibbles[count-1];
+      consumed += n;
+      kept = 0;
+    }
+    else{
+      // whole lines only, a line cut off by the block goes with the next one
+      size_t begin = 0;
+      while(true){
+        const char* newline = (const char*)memchr(text.data() + begin, '\n', n - begin);
+        if(!newline && !last) break;
+        size_t end = newline ? newline - text.data() : n;
+        std::string_view view(text.data() + begin, end - begin);
+        begin = end + 1;
+        if(!view.empty() && view.back() == '\r') view.remove_suffix(1);
+        if(view.find_first_not_of(" \t") != std::string_view::npos){
+          DumpLine parsed;
+          bytes.clear();
+          if(!parseDumpLine(view, nibbles, bytes, parsed)){
+            error = "line " + std::to_string(line) + " doesn't start with an offset";
+            break;
+          }
+          if(!output.seek(parsed.offset, error)) break;
+          output.buffer += bytes;
+          output.added(bytes.size());
+        }
+        line++;
+        if(!newline) break;
+      }
+      kept = begin < n ? n - begin : 0;
+      memmove(&text[0], text.data() + n - kept, kept);
+      if(kept == text.size()) text.resize(text.size()*2);
+    }
+    if(last) break;
+  }
+  if(plain && pending && error.empty()) error = "odd number of hex digits";
+  output.flush();
+  if(in != stdin) fclose(in);
+  bool ok = output.ok && (out == stdout ? fflush(out) : fclose(out)) == 0;
+  if(!error.empty()) fprintf(stderr, "%s: %s\n", paths[0], error.data());
+  else if(!ok) fprintf(stderr, "can't write %s\n", paths[1]);
+  return error.empty() && ok ? 0 : 1;
+}
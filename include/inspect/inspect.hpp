@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include <span/span.hpp>
+
+// Decodes the bytes under the cursor as every common number type. The
+// decoders are instantiated per type at compile time and read through memcpy,
+// so any offset is fine, nothing needs to be aligned.
+
+template<typename T>
+T byteswap(T v){
+  if constexpr(sizeof(T) == 1) return v;
+  else if constexpr(sizeof(T) == 2) return __builtin_bswap16(v);
+  else if constexpr(sizeof(T) == 4) return __builtin_bswap32(v);
+  else return __builtin_bswap64(v);
+}
+
+template<size_t bytes> struct UintOf;
+template<> struct UintOf<1>{ typedef uint8_t type; };
+template<> struct UintOf<2>{ typedef uint16_t type; };
+template<> struct UintOf<4>{ typedef uint32_t type; };
+template<> struct UintOf<8>{ typedef uint64_t type; };
+
+// the bytes at p as a T stored in the given byte order
+template<typename T>
+T load(const uint8_t* p, bool bigEndian){
+  typedef typename UintOf<sizeof(T)>::type U;
+  U bits;
+  memcpy(&bits, p, sizeof(bits));
+  if(bigEndian == (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) bits = byteswap(bits);
+  T v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+// IEEE half precision, there's no native type for it
+struct Half{
+  uint16_t bits;
+};
+
+float halfToFloat(uint16_t h){
+  int exponent = h >> 10 & 0x1f;
+  float mantissa = h & 0x3ff;
+  float v;
+  if(exponent == 0) v = std::ldexp(mantissa, -24);
+  else if(exponent == 31) v = mantissa == 0 ? INFINITY : NAN;
+  else v = std::ldexp(mantissa + 1024, exponent - 25);
+  return h & 0x8000 ? -v : v;
+}
+
+template<typename T>
+int formatValue(const uint8_t* p, size_t avail, bool bigEndian, char* out, size_t n){
+  if constexpr(std::is_same_v<T, Half>){
+    return snprintf(out, n, "%g", halfToFloat(load<uint16_t>(p, bigEndian)));
+  }
+  else if constexpr(std::is_floating_point_v<T>){
+    return snprintf(out, n, "%.*g", std::is_same_v<T, float> ? 9 : 17, (double)load<T>(p, bigEndian));
+  }
+  else if constexpr(std::is_signed_v<T>){
+    return snprintf(out, n, "%lld", (long long)load<T>(p, bigEndian));
+  }
+  else{
+    return snprintf(out, n, "%llu", (unsigned long long)load<T>(p, bigEndian));
+  }
+}
+
+// LEB128 has no byte order, avail is how many bytes there are to read
+template<bool isSigned>
+int formatLeb128(const uint8_t* p, size_t avail, bool bigEndian, char* out, size_t n){
+  uint64_t v = 0;
+  int shift = 0;
+  size_t used = 0;
+  while(used < avail && used < 10){
+    uint8_t b = p[used++];
+    if(shift < 64) v |= (uint64_t)(b & 0x7f) << shift;
+    shift += 7;
+    if(b & 0x80) continue;
+    if(isSigned && shift < 64 && b & 0x40) v |= ~0ull << shift;
+    if(isSigned) return snprintf(out, n, "%lld (%zu bytes)", (long long)v, used);
+    return snprintf(out, n, "%llu (%zu bytes)", (unsigned long long)v, used);
+  }
+  return snprintf(out, n, "-");
+}
+
+struct InspectorType{
+  const char* name;
+  size_t size; // bytes needed, 1 for variable length
+  bool ordered; // has a byte order
+  int (*format)(const uint8_t* p, size_t avail, bool bigEndian, char* out, size_t n);
+};
+
+const InspectorType inspectorTypes[] = {
+  {"u8",  1, false, formatValue<uint8_t>},
+  {"i8",  1, false, formatValue<int8_t>},
+  {"u16", 2, true,  formatValue<uint16_t>},
+  {"i16", 2, true,  formatValue<int16_t>},
+  {"u32", 4, true,  formatValue<uint32_t>},
+  {"i32", 4, true,  formatValue<int32_t>},
+  {"u64", 8, true,  formatValue<uint64_t>},
+  {"i64", 8, true,  formatValue<int64_t>},
+  {"f16", 2, true,  formatValue<Half>},
+  {"f32", 4, true,  formatValue<float>},
+  {"f64", 8, true,  formatValue<double>},
+  {"uleb128", 1, false, formatLeb128<false>},
+  {"sleb128", 1, false, formatLeb128<true>},
+};
+const size_t inspectorTypeCount = sizeof(inspectorTypes)/sizeof(inspectorTypes[0]);
+
+// Formatted values for one position. They're only redone when the position
+// or the buffer changes, drawing just prints the stored text
+struct Inspector{
+  static const size_t TEXT = 32;
+  char little[inspectorTypeCount][TEXT];
+  char big[inspectorTypeCount][TEXT];
+
+  const void* buffer = nullptr;
+  size_t offset = SIZE_MAX;
+  uint64_t version = 0;
+
+  // key is anything that tells buffers apart, version changes with every edit
+  void update(const ByteSource& source, const void* key, uint64_t bufferVersion, size_t at){
+    if(key == buffer && at == offset && bufferVersion == version) return;
+    buffer = key;
+    offset = at;
+    version = bufferVersion;
+
+    // longest thing decoded is a 10 byte LEB128
+    uint8_t bytes[10];
+    size_t avail = 0;
+    while(avail < sizeof(bytes) && at+avail < source.size){
+      Span s = source.span(at+avail);
+      size_t take = std::min(s.end - (at+avail), sizeof(bytes) - avail);
+      memcpy(bytes+avail, s.data + (at+avail - s.begin), take);
+      avail += take;
+    }
+
+    for(size_t t = 0; t < inspectorTypeCount; t++){
+      const InspectorType& type = inspectorTypes[t];
+      big[t][0] = 0;
+      if(type.size > avail){
+        snprintf(little[t], TEXT, "-");
+        continue;
+      }
+      type.format(bytes, avail, false, little[t], TEXT);
+      if(type.ordered) type.format(bytes, avail, true, big[t], TEXT);
+    }
+  }
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+size_t workerCount(){
+  size_t n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+// Runs task(0) .. task(count-1) on every core. Tasks are handed out one at a
+// time from a shared counter, so a thread that drew small tasks keeps pulling
+// more while another is still busy with a big one. threads caps how many
+// run at once, for callers that are on a worker of their own already.
+void parallelFor(size_t count, std::function<void(size_t)> task, size_t threads = workerCount()){
+  threads = std::min(threads, count);
+  std::atomic<size_t> next = 0;
+  auto worker = [&](){
+    for(size_t i = next++; i < count; i = next++) task(i);
+  };
+  if(threads <= 1){
+    worker();
+    return;
+  }
+  std::vector<std::thread> pool;
+  for(size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+  worker();
+  for(auto& t: pool) t.join();
+}
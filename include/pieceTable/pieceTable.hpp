@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <span/span.hpp>
+
+// Everything the pieces point into: the contents files were opened with and
+// the bytes edits have added. Bytes in here are never changed once a piece
+// refers to them, storages only grow at the end.
+std::deque<std::string> storages;
+
+size_t addStorage(std::string data){
+  storages.push_back(std::move(data));
+  return storages.size()-1;
+}
+
+struct Piece{
+  uint32_t storage;
+  size_t offset;
+  size_t size;
+};
+
+bool writePieces(const std::vector<Piece>& pieces, FILE* out){
+  for(const Piece& p: pieces){
+    if(fwrite(storages[p.storage].data() + p.offset, 1, p.size, out) != p.size) return false;
+  }
+  return true;
+}
+
+// The buffer as a list of pieces of storage. Edits only ever add bytes to
+// the add storage and rearrange pieces, so nothing is copied or moved.
+struct PieceTable{
+  std::vector<Piece> pieces;
+  std::vector<size_t> starts; // offset in the buffer of every piece
+  size_t length = 0;
+  uint32_t original; // what the buffer started as
+  uint32_t add;
+  uint64_t version = 0; // bumped by every edit
+
+  void init(std::string data){
+    pieces.clear();
+    length = data.size();
+    original = addStorage(std::move(data));
+    if(length > 0) pieces.push_back({original, 0, length});
+    add = addStorage("");
+    reindex(0);
+  }
+
+  size_t size() const{
+    return length;
+  }
+
+  void reindex(size_t from){
+    starts.resize(pieces.size());
+    size_t offset = from == 0 ? 0 : starts[from-1] + pieces[from-1].size;
+    for(size_t i = from; i < pieces.size(); i++){
+      starts[i] = offset;
+      offset += pieces[i].size;
+    }
+  }
+
+  // index of the piece holding offset
+  size_t find(size_t offset) const{
+    return std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+  }
+
+  Span span(size_t offset) const{
+    size_t i = find(offset);
+    const Piece& p = pieces[i];
+    return Span{storages[p.storage].data() + p.offset, starts[i], starts[i] + p.size};
+  }
+
+  ByteSource source() const{
+    return ByteSource{[this](size_t offset){ return span(offset); }, length};
+  }
+
+  const char* view(size_t offset, size_t n, std::string& scratch) const{
+    return source().view(offset, n, scratch);
+  }
+
+  uint8_t at(size_t offset) const{
+    Span s = span(offset);
+    return s.data[offset - s.begin];
+  }
+
+  // makes a piece start at offset, returns its index
+  size_t splitAt(size_t offset){
+    if(offset == length) return pieces.size();
+    size_t i = find(offset);
+    size_t cut = offset - starts[i];
+    if(cut == 0) return i;
+    Piece tail = pieces[i];
+    tail.offset += cut;
+    tail.size -= cut;
+    pieces[i].size = cut;
+    pieces.insert(pieces.begin()+i+1, tail);
+    starts.insert(starts.begin()+i+1, offset);
+    return i+1;
+  }
+
+  // the pieces holding n bytes at offset, cut to fit. Storage never changes,
+  // so they keep pointing at the same bytes whatever happens to this table
+  std::vector<Piece> slice(size_t offset, size_t n) const{
+    std::vector<Piece> out;
+    for(size_t i = find(offset); n > 0; i++){
+      Piece p = pieces[i];
+      size_t skip = offset - starts[i];
+      p.offset += skip;
+      p.size = std::min(p.size - skip, n);
+      out.push_back(p);
+      offset += p.size;
+      n -= p.size;
+    }
+    return out;
+  }
+
+  // replaces removed bytes at offset with the bytes of pieces, which can come
+  // from any table. Only the piece list changes, no bytes are copied
+  void splice(size_t offset, size_t removed, const std::vector<Piece>& inserted){
+    auto follows = [](const Piece& a, const Piece& b){
+      return a.storage == b.storage && a.offset + a.size == b.offset;
+    };
+    std::vector<Piece> merged;
+    size_t added = 0;
+    for(const Piece& p: inserted){
+      if(p.size == 0) continue;
+      if(!merged.empty() && follows(merged.back(), p)) merged.back().size += p.size;
+      else merged.push_back(p);
+      added += p.size;
+    }
+
+    size_t a = splitAt(offset);
+    size_t b = splitAt(offset+removed);
+    pieces.erase(pieces.begin()+a, pieces.begin()+b);
+    // typing runs on from the last edit, keep growing the same piece
+    if(a > 0 && !merged.empty() && follows(pieces[a-1], merged.front())){
+      pieces[a-1].size += merged.front().size;
+      merged.erase(merged.begin());
+    }
+    pieces.insert(pieces.begin()+a, merged.begin(), merged.end());
+    // only now, splitAt goes by the old length
+    length = length - removed + added;
+    reindex(a > 0 ? a-1 : 0);
+    version++;
+  }
+
+  // replaces removed bytes at offset with inserted bytes from data
+  void replace(size_t offset, size_t removed, const char* data, size_t inserted){
+    std::string& added = storages[add];
+    size_t addOffset = added.size();
+    added.append(data, inserted);
+    splice(offset, removed, {Piece{add, addOffset, inserted}});
+  }
+
+  // writes through a temporary next to path so a failed write leaves the old file
+  bool save(std::string path) const{
+    std::string tmp = path + ".tmp";
+    FILE* out = fopen(tmp.data(), "wb");
+    if(!out) return false;
+    bool ok = writePieces(pieces, out);
+    ok &= fclose(out) == 0;
+    if(!ok || rename(tmp.data(), path.data()) != 0){
+      remove(tmp.data());
+      return false;
+    }
+    return true;
+  }
+};
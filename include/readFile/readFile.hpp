@@ -5,16 +5,49 @@
 
 #include <fstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 std::string readFile(std::string path, std::ios_base::openmode openmode = std::fstream::binary){
   std::ifstream file(path, openmode);
   if(!file){
-    printf("%s is not a valid file path\n", path.data());
+    fprintf(stderr, "%s is not a valid file path\n", path.data());
     return "";
   }
-  std::string line, text;
-  while (std::getline(file, line)) {
-    text.append(line + "\n");
-  }
+  std::string text;
+  file.seekg(0, std::ios::end);
+  text.resize(file.tellg());
+  file.seekg(0, std::ios::beg);
+  file.read(text.data(), text.size());
   file.close();
   return text;
 }
+
+// A file mapped read only, for reading big files front to back without
+// copying them in. Empty files have no mapping and data stays null
+struct MappedFile{
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+  bool open(const char* path){
+    int fd = ::open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0){
+      if(fd >= 0) close(fd);
+      return false;
+    }
+    size = st.st_size;
+    void* mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if(mapped == MAP_FAILED) return false;
+    data = (const uint8_t*)mapped;
+    if(data) madvise(mapped, size, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  ~MappedFile(){
+    if(data) munmap((void*)data, size);
+  }
+};
@@ -0,0 +1,526 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <span/span.hpp>
+
+// Byte oriented regex: the pattern is compiled to an NFA once and the DFA is
+// built lazily while scanning, one state per distinct set of NFA states
+// actually reached. Input comes in as spans, the DFA state carries over from
+// one span to the next so a match may straddle any number of them.
+//
+// Syntax: literals, . (any byte, newline included), [a-z] [^...], \xHH,
+// \d \w \s and their negations, \n \r \t \0, ( ) (?: ), |, * + ? {m} {m,} {m,n}
+//
+// Matches are reported in the order they end: the scan stops at the first
+// byte that completes a match, walks back to the leftmost start that can end
+// there and then forward again to the longest end from that start. Matches
+// never overlap.
+
+typedef std::array<uint64_t, 4> ByteSet;
+
+bool byteSetHas(const ByteSet& s, uint8_t c){
+  return s[c >> 6] >> (c & 63) & 1;
+}
+
+void byteSetAdd(ByteSet& s, int lo, int hi){
+  for(int c = lo; c <= hi; c++) s[c >> 6] |= 1ull << (c & 63);
+}
+
+struct RegexNode{
+  enum Type{
+    SET,
+    CAT,
+    ALT,
+    REPEAT,
+    EMPTY,
+  } type;
+  ByteSet set;
+  int a, b;
+  int min, max; // max == -1 for unbounded
+};
+
+struct RegexParser{
+  std::string_view p;
+  size_t i = 0;
+  std::vector<RegexNode> nodes;
+  std::string error;
+
+  int node(RegexNode n){
+    nodes.push_back(n);
+    return nodes.size()-1;
+  }
+  bool end(){
+    return i >= p.size();
+  }
+  int fail(const char* msg){
+    if(error.empty()) error = msg;
+    return -1;
+  }
+
+  int parseAlt(){
+    int left = parseCat();
+    while(left >= 0 && !end() && p[i] == '|'){
+      i++;
+      int right = parseCat();
+      if(right < 0) return -1;
+      left = node({RegexNode::ALT, {}, left, right});
+    }
+    return left;
+  }
+
+  int parseCat(){
+    int left = node({RegexNode::EMPTY});
+    while(!end() && p[i] != '|' && p[i] != ')'){
+      int right = parseRepeat();
+      if(right < 0) return -1;
+      left = nodes[left].type == RegexNode::EMPTY ? right : node({RegexNode::CAT, {}, left, right});
+    }
+    return left;
+  }
+
+  int parseRepeat(){
+    int a = parseAtom();
+    while(a >= 0 && !end()){
+      int min, max;
+      if(p[i] == '*'){ min = 0; max = -1; }
+      else if(p[i] == '+'){ min = 1; max = -1; }
+      else if(p[i] == '?'){ min = 0; max = 1; }
+      else if(p[i] == '{'){
+        i++;
+        if(!parseInt(min)) return fail("Expected a number after {");
+        max = min;
+        if(!end() && p[i] == ','){
+          i++;
+          max = -1;
+          if(!end() && p[i] != '}' && !parseInt(max)) return fail("Expected a number after ,");
+        }
+        if(end() || p[i] != '}') return fail("Expected }");
+        if(max != -1 && max < min) return fail("Repeat range is backwards");
+        if(min > 1000 || max > 1000) return fail("Repeat count over 1000");
+      }
+      else break;
+      i++;
+      a = node({RegexNode::REPEAT, {}, a, -1, min, max});
+    }
+    return a;
+  }
+
+  bool parseInt(int& out){
+    size_t start = i;
+    out = 0;
+    while(!end() && p[i] >= '0' && p[i] <= '9' && out < 100000) out = out*10 + p[i++] - '0';
+    return i != start;
+  }
+
+  int hexDigit(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  // parses the escape after a backslash into set, returns false on error
+  bool parseEscape(ByteSet& set){
+    if(end()){
+      fail("Trailing backslash");
+      return false;
+    }
+    char c = p[i++];
+    bool negate = false;
+    ByteSet s = {};
+    switch(c){
+      case 'x': {
+        int hi = i < p.size() ? hexDigit(p[i]) : -1;
+        int lo = i+1 < p.size() ? hexDigit(p[i+1]) : -1;
+        if(hi < 0 || lo < 0){
+          fail("Expected two hex digits after \\x");
+          return false;
+        }
+        i += 2;
+        byteSetAdd(s, hi << 4 | lo, hi << 4 | lo);
+      }; break;
+      case 'D': negate = true; [[fallthrough]];
+      case 'd': byteSetAdd(s, '0', '9'); break;
+      case 'W': negate = true; [[fallthrough]];
+      case 'w': {
+        byteSetAdd(s, '0', '9');
+        byteSetAdd(s, 'a', 'z');
+        byteSetAdd(s, 'A', 'Z');
+        byteSetAdd(s, '_', '_');
+      }; break;
+      case 'S': negate = true; [[fallthrough]];
+      case 's': {
+        byteSetAdd(s, '\t', '\r');
+        byteSetAdd(s, ' ', ' ');
+      }; break;
+      case 'n': byteSetAdd(s, '\n', '\n'); break;
+      case 'r': byteSetAdd(s, '\r', '\r'); break;
+      case 't': byteSetAdd(s, '\t', '\t'); break;
+      case '0': byteSetAdd(s, 0, 0); break;
+      default: byteSetAdd(s, (uint8_t)c, (uint8_t)c); break;
+    }
+    if(negate) for(uint64_t& w: s) w = ~w;
+    for(int w = 0; w < 4; w++) set[w] |= s[w];
+    return true;
+  }
+
+  int parseClass(){
+    ByteSet set = {};
+    bool negate = false;
+    if(!end() && p[i] == '^'){
+      negate = true;
+      i++;
+    }
+    bool first = true;
+    while(true){
+      if(end()) return fail("Missing ]");
+      if(p[i] == ']' && !first) break;
+      first = false;
+      int lo = 0;
+      if(p[i] == '\\'){
+        i++;
+        ByteSet single = {};
+        if(!parseEscape(single)) return -1;
+        // only a single byte escape can start a range
+        int count = 0;
+        for(int c = 0; c < 256; c++) if(byteSetHas(single, c)){ lo = c; count++; }
+        if(count != 1){
+          for(int w = 0; w < 4; w++) set[w] |= single[w];
+          continue;
+        }
+      }
+      else lo = (uint8_t)p[i++];
+      int hi = lo;
+      if(i+1 < p.size() && p[i] == '-' && p[i+1] != ']'){
+        i++;
+        if(p[i] == '\\'){
+          i++;
+          ByteSet single = {};
+          if(!parseEscape(single)) return -1;
+          hi = -1;
+          for(int c = 0; c < 256; c++) if(byteSetHas(single, c)){ hi = c; break; }
+        }
+        else hi = (uint8_t)p[i++];
+        if(hi < lo) return fail("Class range is backwards");
+      }
+      byteSetAdd(set, lo, hi);
+    }
+    i++;
+    if(negate) for(uint64_t& w: set) w = ~w;
+    return node({RegexNode::SET, set});
+  }
+
+  int parseAtom(){
+    char c = p[i++];
+    ByteSet set = {};
+    switch(c){
+      case '(': {
+        if(i+1 < p.size() && p[i] == '?' && p[i+1] == ':') i += 2;
+        int inner = parseAlt();
+        if(inner < 0) return -1;
+        if(end() || p[i] != ')') return fail("Missing )");
+        i++;
+        return inner;
+      };
+      case '[': return parseClass();
+      case '.': byteSetAdd(set, 0, 255); break;
+      case '\\': if(!parseEscape(set)) return -1; break;
+      case '*':
+      case '+':
+      case '?':
+      case '{': return fail("Nothing to repeat");
+      default: byteSetAdd(set, (uint8_t)c, (uint8_t)c); break;
+    }
+    return node({RegexNode::SET, set});
+  }
+};
+
+struct NfaState{
+  int set; // index into the set list, SPLIT or MATCH
+  int out;
+  int out1;
+};
+
+enum{
+  NFA_SPLIT = -1,
+  NFA_MATCH = -2,
+};
+
+struct Nfa{
+  std::vector<NfaState> states;
+  std::vector<ByteSet> sets;
+  int start;
+
+  int add(NfaState s){
+    states.push_back(s);
+    return states.size()-1;
+  }
+
+  // builds the states for node back to front, returns the entry state that
+  // continues into next. reverse builds the automaton for the reversed pattern
+  int build(const std::vector<RegexNode>& nodes, int n, int next, bool reverse){
+    const RegexNode& node = nodes[n];
+    switch(node.type){
+      case RegexNode::EMPTY: return next;
+      case RegexNode::SET: {
+        sets.push_back(node.set);
+        return add({(int)sets.size()-1, next, -1});
+      };
+      case RegexNode::CAT: {
+        if(reverse) return build(nodes, node.b, build(nodes, node.a, next, reverse), reverse);
+        return build(nodes, node.a, build(nodes, node.b, next, reverse), reverse);
+      };
+      case RegexNode::ALT: {
+        int a = build(nodes, node.a, next, reverse);
+        int b = build(nodes, node.b, next, reverse);
+        return add({NFA_SPLIT, a, b});
+      };
+      case RegexNode::REPEAT: {
+        int tail = next;
+        if(node.max == -1){
+          int loop = add({NFA_SPLIT, -1, next});
+          states[loop].out = build(nodes, node.a, loop, reverse);
+          tail = loop;
+        }
+        else{
+          for(int k = node.min; k < node.max; k++){
+            tail = add({NFA_SPLIT, build(nodes, node.a, tail, reverse), next});
+            next = tail;
+          }
+        }
+        for(int k = 0; k < node.min; k++){
+          tail = build(nodes, node.a, tail, reverse);
+        }
+        return tail;
+      };
+    }
+    return next;
+  }
+};
+
+// lazily built DFA over an NFA, with a bounded cache of states
+struct Dfa{
+  Nfa nfa;
+  bool unanchored;
+  uint8_t classOf[256];
+  int classCount;
+  uint8_t classByte[256];
+
+  // States are addressed by row, the offset of their first entry in table.
+  // An entry holds the next row shifted left by one with the low bit set if
+  // that state matches, or -1 if the transition hasn't been built yet.
+  std::vector<std::vector<int>> stateSets;
+  std::vector<uint8_t> matching; // indexed by row
+  std::vector<int32_t> table;
+  std::map<std::vector<int>, int> rows;
+  std::vector<int> startSet;
+  int start;
+  int deadRow;
+  size_t cacheLimit = 4096;
+  size_t flushes = 0;
+
+  std::vector<uint32_t> mark;
+  uint32_t stamp = 0;
+
+  void init(Nfa in_nfa, bool in_unanchored){
+    nfa = in_nfa;
+    unanchored = in_unanchored;
+
+    // bytes that no set tells apart share a column in the table
+    bool boundary[256] = {true};
+    for(ByteSet& s: nfa.sets){
+      for(int c = 1; c < 256; c++){
+        if(byteSetHas(s, c) != byteSetHas(s, c-1)) boundary[c] = true;
+      }
+    }
+    classCount = 0;
+    for(int c = 0; c < 256; c++){
+      if(boundary[c]) classByte[classCount++] = c;
+      classOf[c] = classCount-1;
+    }
+
+    mark.assign(nfa.states.size(), 0);
+    startSet.clear();
+    stamp++;
+    closure(nfa.start, startSet);
+    std::sort(startSet.begin(), startSet.end());
+    flush();
+  }
+
+  void closure(int s, std::vector<int>& out){
+    if(s < 0 || mark[s] == stamp) return;
+    mark[s] = stamp;
+    NfaState& st = nfa.states[s];
+    if(st.set == NFA_SPLIT){
+      closure(st.out, out);
+      closure(st.out1, out);
+    }
+    else out.push_back(s);
+  }
+
+  int intern(std::vector<int>& set){
+    auto it = rows.find(set);
+    if(it != rows.end()) return it->second;
+    int row = table.size();
+    bool m = false;
+    for(int s: set) m |= nfa.states[s].set == NFA_MATCH;
+    stateSets.push_back(set);
+    table.resize(table.size() + classCount, -1);
+    matching.resize(table.size(), 0);
+    matching[row] = m;
+    if(set.empty()) deadRow = row;
+    rows[set] = row;
+    return row;
+  }
+
+  void flush(){
+    stateSets.clear();
+    matching.clear();
+    table.clear();
+    rows.clear();
+    deadRow = -1;
+    start = intern(startSet);
+  }
+
+  bool dead(int row){
+    return !unanchored && row == deadRow;
+  }
+
+  int32_t computeNext(int row, uint8_t c){
+    std::vector<int> next;
+    stamp++;
+    for(int n: stateSets[row/classCount]){
+      NfaState& st = nfa.states[n];
+      if(st.set >= 0 && byteSetHas(nfa.sets[st.set], c)) closure(st.out, next);
+    }
+    if(unanchored) for(int n: startSet) closure(n, next);
+    std::sort(next.begin(), next.end());
+    if(stateSets.size() >= cacheLimit){
+      // drop everything built so far, the scan picks up from the new state
+      flush();
+      flushes++;
+      int to = intern(next);
+      return to << 1 | matching[to];
+    }
+    int to = intern(next);
+    int32_t entry = to << 1 | matching[to];
+    table[row + classOf[c]] = entry;
+    return entry;
+  }
+
+  int step(int row, uint8_t c){
+    int32_t n = table[row + classOf[c]];
+    if(n < 0) n = computeNext(row, c);
+    return n >> 1;
+  }
+
+  // steps through [p, end) and stops right after the first byte that lands
+  // in a matching state, returns where it stopped
+  const uint8_t* run(int& row, const uint8_t* p, const uint8_t* end){
+    int s = row;
+    const int32_t* t = table.data();
+    while(p < end){
+      int32_t n = t[s + classOf[*p++]];
+      if(n < 0){
+        n = computeNext(s, p[-1]);
+        t = table.data();
+      }
+      s = n >> 1;
+      if(n & 1) break;
+    }
+    row = s;
+    return p;
+  }
+};
+
+struct Regex{
+  std::string error;
+  Dfa find;   // unanchored, stops at the first byte that ends a match
+  Dfa back;   // reversed pattern, walks back to the leftmost start
+  Dfa extend; // anchored, walks forward to the longest end
+
+  bool compile(std::string_view pattern){
+    RegexParser parser{pattern};
+    int root = parser.end() ? -1 : parser.parseAlt();
+    if(root >= 0 && !parser.end()) root = parser.fail("Unmatched )");
+    if(root < 0){
+      error = parser.error.empty() ? "Empty pattern" : parser.error;
+      return false;
+    }
+    Nfa forward, reverse;
+    forward.start = forward.build(parser.nodes, root, forward.add({NFA_MATCH, -1, -1}), false);
+    reverse.start = reverse.build(parser.nodes, root, reverse.add({NFA_MATCH, -1, -1}), true);
+    if(forward.states.size() > 200000){
+      error = "Pattern is too big";
+      return false;
+    }
+    find.init(forward, true);
+    if(find.matching[find.start]){
+      error = "Pattern matches empty input";
+      return false;
+    }
+    extend.init(forward, false);
+    back.init(reverse, false);
+    return true;
+  }
+
+  size_t leftmostStart(SpanSource& source, size_t end, size_t lowest){
+    int s = back.start;
+    size_t best = end;
+    size_t pos = end;
+    while(pos > lowest){
+      Span sp = source(pos-1);
+      size_t stop = std::max(sp.begin, lowest);
+      for(; pos > stop; pos--){
+        s = back.step(s, sp.data[pos-1-sp.begin]);
+        if(back.matching[s]) best = pos-1;
+        if(back.dead(s)) return best;
+      }
+    }
+    return best;
+  }
+
+  size_t longestEnd(SpanSource& source, size_t begin, size_t to){
+    int s = extend.start;
+    size_t best = begin;
+    size_t pos = begin;
+    while(pos < to){
+      Span sp = source(pos);
+      size_t stop = std::min(sp.end, to);
+      for(; pos < stop; pos++){
+        s = extend.step(s, sp.data[pos-sp.begin]);
+        if(extend.matching[s]) best = pos+1;
+        if(extend.dead(s)) return best;
+      }
+    }
+    return best;
+  }
+
+  // calls onMatch(begin, end) for every match inside [from, to)
+  void scan(SpanSource source, size_t from, size_t to, std::function<void(size_t, size_t)> onMatch){
+    int s = find.start;
+    size_t resume = from;
+    size_t pos = from;
+    while(pos < to){
+      Span sp = source(pos);
+      const uint8_t* p = (const uint8_t*)sp.data + (pos-sp.begin);
+      const uint8_t* end = p + (std::min(sp.end, to)-pos);
+      pos += find.run(s, p, end) - p;
+      if(find.matching[s]){
+        size_t begin = leftmostStart(source, pos, resume);
+        size_t matchEnd = longestEnd(source, begin, to);
+        onMatch(begin, matchEnd);
+        pos = resume = matchEnd;
+        s = find.start;
+      }
+    }
+  }
+};
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+
+#include <checksum/checksum.hpp>
+#include <command/command.hpp>
+#include <dump/dump.hpp>
+#include <parallel/parallel.hpp>
+#include <search/search.hpp>
+#include <span/span.hpp>
+#include <transform/transform.hpp>
+
+// deditor --script file.ds target...
+// Runs the commands of a script against every target without a terminal.
+// Targets are independent, so they're handed to a worker per core and each
+// one is read, edited and written on its own. The cores left over when there
+// are fewer targets than cores are split between them for hash and
+// transform. What a target prints is held back until the ones before it are
+// done, so output comes in the order the targets were given. Past
+// SCRIPT_HELD bytes it's held in a temporary file. One command per line, #
+// starts a comment:
+//
+//   select OFFSET LENGTH | select all   range the commands below work on
+//   search PATTERN                      offsets of matches in the range
+//   patch OFFSET BYTES                  overwrites, may grow the file
+//   transform NAME [KEY]                as X does in the editor
+//   hash                                checksums of the range
+//   dump                                xxd style hex dump of the range
+//   write [PATH]                        {} in PATH is the target's path
+
+const size_t SCRIPT_HELD = 1 << 20;
+
+struct ScriptTarget{
+  std::string path;
+  std::string data;
+  size_t begin = 0;
+  size_t end = SIZE_MAX; // clamped to the size, so all of it by default
+  size_t threads = 1;    // for the work on a range
+  std::string out;
+  FILE* spill = nullptr; // what was printed before out, if it got too big
+
+  size_t selEnd() const{
+    return std::min(end, data.size());
+  }
+
+  size_t selBegin() const{
+    return std::min(begin, selEnd());
+  }
+
+  ByteSource source() const{
+    const char* p = data.data();
+    size_t n = data.size();
+    return ByteSource{[p, n](size_t offset){ return Span{p, 0, n}; }, n};
+  }
+
+  void print(const char* format, ...) __attribute__((format(printf, 2, 3))){
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out += path;
+    out += ": ";
+    out += line;
+    out += '\n';
+    spillOver();
+  }
+
+  void spillOver(){
+    if(out.size() < SCRIPT_HELD) return;
+    if(!spill) spill = tmpfile();
+    // without one it all stays in memory
+    if(spill && fwrite(out.data(), 1, out.size(), spill) == out.size()) out.clear();
+  }
+
+  // everything printed, in order, then forgets it
+  void flush(FILE* to){
+    if(spill){
+      char block[1 << 16];
+      rewind(spill);
+      for(size_t n; (n = fread(block, 1, sizeof(block), spill)) > 0;) fwrite(block, 1, n, to);
+      fclose(spill);
+      spill = nullptr;
+    }
+    fwrite(out.data(), 1, out.size(), to);
+    out = std::string();
+  }
+};
+
+struct ScriptCommand{
+  const char* name;
+  const char* usage;
+  size_t minArgs, maxArgs;
+  // false with error set stops the script for this target
+  bool (*run)(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error);
+};
+
+bool scriptSelect(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error){
+  if(args.size() == 2 && args[1] == "all"){
+    t.begin = 0;
+    t.end = SIZE_MAX;
+    return true;
+  }
+  size_t offset, length;
+  if(args.size() != 3 || !parseNumber(args[1], offset) || !parseNumber(args[2], length)){
+    error = "expected select OFFSET LENGTH or select all";
+    return false;
+  }
+  t.begin = offset;
+  t.end = length > SIZE_MAX - offset ? SIZE_MAX : offset + length;
+  return true;
+}
+
+bool scriptSearch(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error){
+  std::string pattern;
+  if(!parsePattern(argsFrom(args, 1), pattern)){
+    error = "invalid pattern, expected hex bytes or \"text\"";
+    return false;
+  }
+  std::vector<size_t> hits;
+  findAll(t.data.data() + t.selBegin(), t.selEnd() - t.selBegin(), t.selBegin(), pattern, hits);
+  for(size_t hit: hits) t.print("match 0x%zx", hit);
+  if(hits.empty()) t.print("no matches");
+  return true;
+}
+
+bool scriptPatch(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error){
+  size_t offset;
+  std::string bytes;
+  if(!parseNumber(args[1], offset) || !parsePattern(argsFrom(args, 2), bytes)){
+    error = "expected patch OFFSET BYTES";
+    return false;
+  }
+  if(offset > t.data.size()){
+    error = "patch at " + std::to_string(offset) + " is past the end";
+    return false;
+  }
+  if(offset + bytes.size() > t.data.size()) t.data.resize(offset + bytes.size());
+  memcpy(&t.data[offset], bytes.data(), bytes.size());
+  return true;
+}
+
+bool scriptTransform(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error){
+  const Transform* transform = findTransform(args[1]);
+  if(!transform){
+    error = "unknown transform " + std::string(args[1]);
+    return false;
+  }
+  KeyStream stream;
+  if(transform->keyed){
+    std::string key;
+    if(args.size() < 3 || !parsePattern(argsFrom(args, 2), key) || key.size() > TRANSFORM_KEY_MAX){
+      error = std::string("expected hex bytes or \"text\" after ") + transform->name;
+      return false;
+    }
+    stream.init(key);
+  }
+  size_t begin = t.selBegin();
+  size_t n = t.selEnd() - begin;
+  std::string out(n, 0);
+  std::atomic<uint64_t> done = 0;
+  std::atomic<bool> cancel = false;
+  transformRange(t.source(), begin, n, *transform, stream, out.data(), done, cancel, t.threads);
+  memcpy(&t.data[begin], out.data(), n);
+  return true;
+}
+
+bool scriptHash(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error){
+  Checksums sums;
+  std::atomic<uint64_t> done = 0;
+  std::atomic<bool> cancel = false;
+  checksumRange(t.source(), t.selBegin(), t.selEnd(), sums, done, cancel, t.threads);
+  char sha[65];
+  for(int b = 0; b < 32; b++) snprintf(sha+b*2, 3, "%02x", sums.sha256[b]);
+  t.print("crc32 %08x crc32c %08x xxh64 %016llx sha256 %s", sums.crc32, sums.crc32c, (unsigned long long)sums.xxh64, sha);
+  return true;
+}
+
+bool scriptDump(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error){
+  t.print("dump 0x%zx-0x%zx", t.selBegin(), t.selEnd());
+  DumpFormat format;
+  size_t step = format.columns << 12;
+  std::string text;
+  for(size_t at = t.selBegin(); at < t.selEnd(); at += step){
+    dumpRows((const uint8_t*)t.data.data() + at, std::min(step, t.selEnd() - at), at, format, text);
+    t.out += text;
+    t.spillOver();
+  }
+  return true;
+}
+
+bool scriptWrite(ScriptTarget& t, const std::vector<std::string_view>& args, std::string& error){
+  std::string path = args.size() > 1 ? std::string(args[1]) : t.path;
+  // on after what was put in, the target's own path may have {} in it
+  for(size_t at = 0; (at = path.find("{}", at)) != std::string::npos; at += t.path.size()) path.replace(at, 2, t.path);
+  std::string tmp = path + ".tmp";
+  FILE* out = fopen(tmp.data(), "wb");
+  bool ok = out && fwrite(t.data.data(), 1, t.data.size(), out) == t.data.size();
+  if(out) ok &= fclose(out) == 0;
+  if(!ok || rename(tmp.data(), path.data()) != 0){
+    remove(tmp.data());
+    error = "can't write " + path;
+    return false;
+  }
+  return true;
+}
+
+const ScriptCommand scriptCommands[] = {
+  {"select",    "select OFFSET LENGTH | select all", 1, 2,        scriptSelect},
+  {"search",    "search PATTERN",                    1, SIZE_MAX, scriptSearch},
+  {"patch",     "patch OFFSET BYTES",                2, SIZE_MAX, scriptPatch},
+  {"transform", "transform NAME [KEY]",              1, SIZE_MAX, scriptTransform},
+  {"hash",      "hash",                              0, 0,        scriptHash},
+  {"dump",      "dump",                              0, 0,        scriptDump},
+  {"write",     "write [PATH]",                      0, 1,        scriptWrite},
+};
+
+// a line of the script, its arguments point into the script's text
+struct ScriptLine{
+  size_t number;
+  const ScriptCommand* command;
+  std::vector<std::string_view> args;
+};
+
+// every line is checked before any target is touched
+bool parseScript(const std::string& text, std::vector<ScriptLine>& lines, std::string& error){
+  size_t number = 0;
+  for(size_t at = 0; at < text.size();){
+    size_t end = text.find('\n', at);
+    if(end == std::string::npos) end = text.size();
+    std::string_view line(text.data() + at, end - at);
+    at = end + 1;
+    number++;
+    if(!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    std::vector<std::string_view> args = splitArgs(line);
+    if(args.empty() || args[0][0] == '#') continue;
+    const ScriptCommand* command = nullptr;
+    for(const ScriptCommand& c: scriptCommands) if(args[0] == c.name) command = &c;
+    if(!command){
+      error = "line " + std::to_string(number) + ": no command " + std::string(args[0]);
+      return false;
+    }
+    if(args.size()-1 < command->minArgs || args.size()-1 > command->maxArgs){
+      error = "line " + std::to_string(number) + ": usage: " + command->usage;
+      return false;
+    }
+    lines.push_back({number, command, std::move(args)});
+  }
+  return true;
+}
+
+bool loadTarget(ScriptTarget& t){
+  FILE* in = fopen(t.path.data(), "rb");
+  if(!in) return false;
+  // directories open too, their size is nothing to go by
+  struct stat st;
+  if(fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode)){
+    fclose(in);
+    return false;
+  }
+  bool ok = fseek(in, 0, SEEK_END) == 0;
+  long size = ok ? ftell(in) : -1;
+  ok = size >= 0 && fseek(in, 0, SEEK_SET) == 0;
+  if(ok){
+    t.data.resize(size);
+    ok = fread(t.data.data(), 1, size, in) == (size_t)size;
+  }
+  fclose(in);
+  return ok;
+}
+
+// returns the exit status: 0 if every target got through the whole script
+int runScript(const char* scriptPath, const std::vector<std::string>& paths){
+  std::string text, error;
+  ScriptTarget script{scriptPath};
+  if(!loadTarget(script)){
+    fprintf(stderr, "can't read %s\n", scriptPath);
+    return 2;
+  }
+  text = std::move(script.data);
+  std::vector<ScriptLine> lines;
+  if(!parseScript(text, lines, error)){
+    fprintf(stderr, "%s: %s\n", scriptPath, error.data());
+    return 2;
+  }
+
+  std::vector<ScriptTarget> outputs(paths.size());
+  std::vector<bool> finished(paths.size(), false);
+  size_t threads = std::max<size_t>(workerCount() / std::max<size_t>(paths.size(), 1), 1);
+  size_t printed = 0;
+  std::atomic<bool> failed = false;
+  std::mutex lock;
+  parallelFor(paths.size(), [&](size_t i){
+    ScriptTarget t;
+    t.path = paths[i];
+    t.threads = threads;
+    if(!loadTarget(t)){
+      t.out = t.path + ": can't read\n";
+      failed = true;
+    }
+    else{
+      for(const ScriptLine& line: lines){
+        std::string error;
+        if(!line.command->run(t, line.args, error)){
+          t.print("line %zu: %s", line.number, error.data());
+          failed = true;
+          break;
+        }
+      }
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    outputs[i].out = std::move(t.out);
+    outputs[i].spill = t.spill;
+    finished[i] = true;
+    for(; printed < paths.size() && finished[printed]; printed++) outputs[printed].flush(stdout);
+  });
+  fflush(stdout);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+struct SearchHit{
+  size_t file;
+  size_t offset;
+};
+
+// "de ad be ef" / "deadbeef" is hex, "\"text\"" is taken literally
+bool parsePattern(std::string_view in, std::string& out){
+  out.clear();
+  if(in.size() > 0 && in[0] == '"'){
+    in.remove_prefix(1);
+    if(in.size() > 0 && in.back() == '"') in.remove_suffix(1);
+    out = in;
+    return out.size() > 0;
+  }
+  int nibble = -1;
+  for(char c: in){
+    int v;
+    if(c >= '0' && c <= '9') v = c - '0';
+    else if(c >= 'a' && c <= 'f') v = c - 'a' + 10;
+    else if(c >= 'A' && c <= 'F') v = c - 'A' + 10;
+    else if(c == ' ') continue;
+    else return false;
+    if(nibble == -1) nibble = v;
+    else{
+      out.push_back((char)(nibble << 4 | v));
+      nibble = -1;
+    }
+  }
+  return nibble == -1 && out.size() > 0;
+}
+
+// appends base+offset of every match that lies inside data[0, size)
+void findAll(const char* data, size_t size, size_t base, const std::string& pattern, std::vector<size_t>& out){
+  if(pattern.size() == 1){
+    const char* end = data+size;
+    for(const char* p = data; (p = (const char*)memchr(p, pattern[0], end-p)); p++){
+      out.push_back(base + (p-data));
+    }
+    return;
+  }
+  std::boyer_moore_horspool_searcher searcher(pattern.begin(), pattern.end());
+  const char* end = data+size;
+  for(const char* p = data;;){
+    p = std::search(p, end, searcher);
+    if(p == end) break;
+    out.push_back(base + (p-data));
+    p++;
+  }
+}
+
+const size_t SEARCH_CHUNK = 4 << 20;
+
+// Searches every buffer at once. Buffers are cut into SEARCH_CHUNK pieces
+// that overlap by pattern.size()-1 bytes, so one big file is spread over all
+// cores while a pile of small ones still gets handed out one by one. done
+// counts the bytes searched, once cancel is set the chunks left are skipped
+// and the hits are only those of the ones done.
+std::vector<SearchHit> searchBuffers(const std::vector<ByteSource>& buffers, const std::string& pattern, std::atomic<uint64_t>& done, const std::atomic<bool>& cancel){
+  struct Task{
+    size_t file;
+    size_t begin;
+    size_t end;
+    std::vector<size_t> hits;
+  };
+  std::vector<Task> tasks;
+  for(size_t f = 0; f < buffers.size(); f++){
+    size_t size = buffers[f].size;
+    for(size_t b = 0; b < size; b += SEARCH_CHUNK){
+      tasks.push_back({f, b, std::min(b+SEARCH_CHUNK, size), {}});
+    }
+  }
+  // biggest first so the short tail tasks fill in the gaps at the end
+  std::vector<size_t> order(tasks.size());
+  for(size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+    return tasks[a].end - tasks[a].begin > tasks[b].end - tasks[b].begin;
+  });
+  parallelFor(order.size(), [&](size_t i){
+    Task& t = tasks[order[i]];
+    if(cancel) return;
+    const ByteSource& buf = buffers[t.file];
+    size_t scanEnd = std::min(t.end + pattern.size() - 1, buf.size);
+    std::string scratch;
+    findAll(buf.view(t.begin, scanEnd-t.begin, scratch), scanEnd-t.begin, t.begin, pattern, t.hits);
+    while(t.hits.size() > 0 && t.hits.back() >= t.end) t.hits.pop_back();
+    done += t.end - t.begin;
+  });
+  std::vector<SearchHit> hits;
+  for(Task& t: tasks){
+    for(size_t offset: t.hits) hits.push_back({t.file, offset});
+  }
+  return hits;
+}
+
+// Hits of one buffer, sorted, in blocks of about SEARCH_BLOCK. Every block
+// has a shift that's added to all of its offsets, an edit rewrites the
+// blocks around it and only moves the shift of the ones after. Offsets are
+// kept less the shift and wrap around like it, only the sum is an offset.
+const size_t SEARCH_BLOCK = 1024;
+
+struct SearchHits{
+  struct Block{
+    size_t shift = 0;
+    std::vector<size_t> offsets;
+    size_t front() const{ return offsets.front() + shift; }
+    size_t back() const{ return offsets.back() + shift; }
+  };
+  std::vector<Block> blocks; // none empty
+  size_t count = 0;
+
+  // a hit, block == blocks.size() past the last one
+  struct At{
+    size_t block;
+    size_t i;
+  };
+
+  size_t size() const{ return count; }
+
+  void clear(){
+    blocks.clear();
+    count = 0;
+  }
+
+  // offsets have to come in order
+  void push_back(size_t offset){
+    if(blocks.empty() || blocks.back().offsets.size() >= SEARCH_BLOCK) blocks.push_back({});
+    Block& b = blocks.back();
+    b.offsets.push_back(offset - b.shift);
+    count++;
+  }
+
+  // first hit at or after offset
+  At lowerBound(size_t offset) const{
+    size_t b = std::partition_point(blocks.begin(), blocks.end(), [&](const Block& k){ return k.back() < offset; }) - blocks.begin();
+    if(b == blocks.size()) return {b, 0};
+    const Block& k = blocks[b];
+    size_t i = std::partition_point(k.offsets.begin(), k.offsets.end(), [&](size_t o){ return o + k.shift < offset; }) - k.offsets.begin();
+    return {b, i};
+  }
+
+  bool atEnd(At a) const{ return a.block == blocks.size(); }
+  size_t operator[](At a) const{ return blocks[a.block].offsets[a.i] + blocks[a.block].shift; }
+
+  void next(At& a) const{
+    if(++a.i == blocks[a.block].offsets.size()){
+      a.block++;
+      a.i = 0;
+    }
+  }
+
+  // a mustn't be the first hit
+  void previous(At& a) const{
+    if(a.i == 0) a.i = blocks[--a.block].offsets.size();
+    a.i--;
+  }
+
+  // how many hits come before a
+  size_t rank(At a) const{
+    size_t r = a.i;
+    for(size_t b = 0; b < a.block; b++) r += blocks[b].offsets.size();
+    return r;
+  }
+
+  // drops the hits in [low, end), moves the ones after by delta and puts
+  // found, which all lie between the two, in their place
+  void replace(size_t low, size_t end, size_t delta, const std::vector<size_t>& found){
+    size_t b = std::partition_point(blocks.begin(), blocks.end(), [&](const Block& k){ return k.back() < low; }) - blocks.begin();
+    size_t k = b;
+    for(; k < blocks.size() && blocks[k].front() < end; k++){
+      Block& block = blocks[k];
+      std::vector<size_t> kept;
+      for(size_t o: block.offsets){
+        o += block.shift;
+        if(o < low) kept.push_back(o);
+        else if(o >= end) kept.push_back(o + delta);
+      }
+      count -= block.offsets.size() - kept.size();
+      block.offsets = std::move(kept);
+      block.shift = 0;
+    }
+    for(size_t after = k; after < blocks.size(); after++) blocks[after].shift += delta;
+    blocks.erase(std::remove_if(blocks.begin()+b, blocks.begin()+k, [](const Block& e){ return e.offsets.empty(); }), blocks.begin()+k);
+    if(found.empty()) return;
+
+    // into the block that has the first hit after them, or the last one
+    At at = lowerBound(low);
+    if(blocks.empty()) blocks.push_back({});
+    if(atEnd(at)) at = {blocks.size()-1, blocks.back().offsets.size()};
+    Block& block = blocks[at.block];
+    std::vector<size_t> moved(found.size());
+    for(size_t i = 0; i < found.size(); i++) moved[i] = found[i] - block.shift;
+    block.offsets.insert(block.offsets.begin()+at.i, moved.begin(), moved.end());
+    count += found.size();
+    if(block.offsets.size() <= 2*SEARCH_BLOCK) return;
+    // a big paste can leave one block with many, cut it up again
+    Block whole = std::move(block);
+    std::vector<Block> pieces;
+    for(size_t i = 0; i < whole.offsets.size(); i += SEARCH_BLOCK){
+      size_t n = std::min(SEARCH_BLOCK, whole.offsets.size() - i);
+      pieces.push_back({whole.shift, std::vector<size_t>(whole.offsets.begin()+i, whole.offsets.begin()+i+n)});
+    }
+    blocks.erase(blocks.begin()+at.block);
+    blocks.insert(blocks.begin()+at.block, std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+  }
+};
+
+// Search remembered for one buffer. After an edit only the edited bytes and
+// pattern.size()-1 bytes either side are searched again, hits past the edit
+// are moved along by the change in length.
+struct ActiveSearch{
+  std::string pattern;
+  SearchHits hits;
+
+  void edited(const ByteSource& buffer, size_t offset, size_t removed, size_t inserted){
+    if(pattern.empty()) return;
+    size_t margin = pattern.size()-1;
+    size_t low = offset > margin ? offset-margin : 0;
+    size_t high = std::min(offset + inserted + margin, buffer.size);
+    std::vector<size_t> found;
+    if(high > low){
+      std::string scratch;
+      findAll(buffer.view(low, high-low, scratch), high-low, low, pattern, found);
+    }
+    // every hit from low on overlaps the edit until it ends
+    hits.replace(low, offset+removed, inserted - removed, found);
+  }
+};
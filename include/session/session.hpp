@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Every key the editor got from the terminal, with the terminal's size at
+// the time and how long after the key before it it came. A replay feeds the
+// same keys to the main loop at the same sizes, so the same screens come
+// out, and times how long each one took to handle and draw. The log is
+// text, one entry a line:
+//
+//   deditor session 1
+//   file PATH                   the files it was started with, in order
+//   size ROWS COLS              the terminal at the start
+//   key DELAY KEY ROWS COLS PROGRESS
+//                               DELAY in ms, KEY as getch returned it,
+//                               PROGRESS the percent of the running job the
+//                               frame before it showed, -1 for none
+//   job                         the background job finished here
+//
+// Jobs run on their thread in a replay too, keys typed meanwhile find the
+// editor busy as they did. They're only finished where the log says, and
+// the frames show the progress they showed then, so timing doesn't leak
+// into what's drawn. Lines are written as keys are read, so the log of a
+// session that crashed has everything up to the crash.
+
+const int SESSION_JOB_DONE = -2; // key of a job line
+
+struct SessionKey{
+  uint32_t delay; // ms since the key before
+  int key;        // -1 for a getch that timed out
+  uint16_t rows, cols;
+  int progress;
+};
+
+double sessionNow(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Session{
+  std::vector<std::string> files;
+  uint16_t rows = 0, cols = 0;
+  std::vector<SessionKey> keys;
+  FILE* record = nullptr;
+
+  // replaying
+  bool replay = false;
+  bool timed = false;   // keys come as far apart as they did
+  size_t next = 0;
+  double start = 0;     // of the replay
+  double due = 0;       // when the next key is, from start
+  double handed = 0;    // when the last key was handed out
+  size_t last = SIZE_MAX; // index of that key until the next one is asked for
+  // a key's index and the time from it to when the next one was asked for
+  std::vector<std::pair<size_t, double>> took;
+
+  bool startRecording(const char* path, const std::vector<std::string>& paths, uint16_t rows, uint16_t cols){
+    record = fopen(path, "w");
+    if(!record) return false;
+    fprintf(record, "deditor session 1\n");
+    for(const std::string& p: paths) fprintf(record, "file %s\n", p.data());
+    fprintf(record, "size %u %u\n", rows, cols);
+    fflush(record);
+    handed = sessionNow();
+    return true;
+  }
+
+  void recordKey(int key, uint16_t rows, uint16_t cols, int progress){
+    double now = sessionNow();
+    fprintf(record, "key %u %d %u %u %d\n", (uint32_t)((now - handed) * 1000), key, rows, cols, progress);
+    fflush(record);
+    handed = now;
+  }
+
+  void recordJobDone(){
+    fprintf(record, "job\n");
+    fflush(record);
+  }
+
+  bool load(const char* path, std::string& error){
+    FILE* in = fopen(path, "r");
+    if(!in){
+      error = std::string("can't read ") + path;
+      return false;
+    }
+    char line[4096];
+    size_t number = 0;
+    bool ok = fgets(line, sizeof(line), in) && strcmp(line, "deditor session 1\n") == 0;
+    if(!ok) error = std::string(path) + " isn't a session log";
+    while(ok && fgets(line, sizeof(line), in)){
+      number++;
+      SessionKey k;
+      unsigned r, c;
+      size_t length = strlen(line);
+      if(length > 0 && line[length-1] == '\n') line[--length] = 0;
+      if(strncmp(line, "file ", 5) == 0) files.push_back(line + 5);
+      else if(sscanf(line, "size %u %u", &r, &c) == 2){
+        rows = r;
+        cols = c;
+      }
+      else if(sscanf(line, "key %u %d %u %u %d", &k.delay, &k.key, &r, &c, &k.progress) == 5){
+        k.rows = r;
+        k.cols = c;
+        keys.push_back(k);
+      }
+      else if(strcmp(line, "job") == 0) keys.push_back({0, SESSION_JOB_DONE, 0, 0, -1});
+      else{
+        error = std::string(path) + ": line " + std::to_string(number+1) + " is damaged";
+        ok = false;
+      }
+    }
+    fclose(in);
+    if(ok && (rows == 0 || cols == 0)){
+      error = std::string(path) + " has no terminal size";
+      ok = false;
+    }
+    return ok;
+  }
+
+  // next key of a replay, false when there are none left
+  bool replayKey(SessionKey& k){
+    double now = sessionNow();
+    if(next == 0) start = now;
+    if(last != SIZE_MAX) took.push_back({last, now - handed});
+    last = SIZE_MAX;
+    // a job the loop didn't get to finish, there's nothing to do with it here
+    while(next < keys.size() && keys[next].key == SESSION_JOB_DONE) next++;
+    if(next == keys.size()) return false;
+    last = next;
+    k = keys[next++];
+    due += k.delay / 1000.0;
+    if(timed && start + due > now){
+      std::this_thread::sleep_for(std::chrono::duration<double>(start + due - now));
+    }
+    handed = sessionNow();
+    return true;
+  }
+
+  // true once, when the log has the running job finish before the next key
+  bool jobDone(){
+    if(next >= keys.size() || keys[next].key != SESSION_JOB_DONE) return false;
+    next++;
+    return true;
+  }
+
+  // what the next frame shows of the running job, -1 for nothing. Past the
+  // end of the log it stays at what the last key had
+  int progress() const{
+    size_t i = next;
+    while(i < keys.size() && keys[i].key == SESSION_JOB_DONE) i++;
+    if(i == keys.size()) i = next-1;
+    return i < keys.size() ? keys[i].progress : -1;
+  }
+
+  // how long the replay took and its slowest keys
+  void report(FILE* out){
+    double total = 0;
+    for(auto& t: took) total += t.second;
+    fprintf(out, "replayed %zu keys in %.3f s, %.3f ms a key\n", took.size(), total, took.empty() ? 0 : total / took.size() * 1000);
+    std::vector<std::pair<size_t, double>> slowest = took;
+    size_t shown = std::min<size_t>(5, slowest.size());
+    std::partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(), [](auto& a, auto& b){ return a.second > b.second; });
+    for(size_t i = 0; i < shown; i++){
+      fprintf(out, "  entry %zu (key %d): %.3f ms\n", slowest[i].first+1, keys[slowest[i].first].key, slowest[i].second * 1000);
+    }
+  }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+// contiguous run of the bytes [begin, end) of a larger buffer
+struct Span{
+  const char* data;
+  size_t begin;
+  size_t end;
+};
+// returns the span that contains offset
+using SpanSource = std::function<Span(size_t offset)>;
+
+// buffer that may be split over any number of spans
+struct ByteSource{
+  SpanSource span;
+  size_t size;
+
+  // pointer to the bytes [offset, offset+n), only copied into scratch when
+  // they cross a span boundary
+  const char* view(size_t offset, size_t n, std::string& scratch) const{
+    if(n == 0) return "";
+    Span s = span(offset);
+    if(offset + n <= s.end) return s.data + (offset - s.begin);
+    scratch.resize(n);
+    size_t done = 0;
+    while(done < n){
+      size_t take = std::min(s.end - (offset+done), n - done);
+      memcpy(&scratch[done], s.data + (offset+done - s.begin), take);
+      done += take;
+      if(done < n) s = span(offset+done);
+    }
+    return scratch.data();
+  }
+
+  uint8_t at(size_t offset) const{
+    Span s = span(offset);
+    return s.data[offset - s.begin];
+  }
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+#include <strings/strings.hpp>
+
+// Byte histogram, entropy and frequent n-grams of a range. Histograms are
+// kept per 64 KiB block, so asking again about a range that overlaps one
+// asked about before only counts the blocks that weren't seen yet and the
+// partial ones at the ends.
+
+const size_t STATS_BLOCK = 64 << 10;
+
+typedef std::array<uint32_t, 256> BlockCounts;
+
+// Four sets of counters: bytes next to each other often repeat and would
+// otherwise wait on the increment of the same counter before them. Only
+// used on a block or two at a time, the counters don't get near wrapping
+void countBytes(const uint8_t* p, size_t n, uint64_t* out){
+  uint32_t c[4][256] = {};
+  size_t i = 0;
+  for(; i+8 <= n; i += 8){
+    uint64_t v;
+    memcpy(&v, p+i, 8);
+    c[0][v & 0xff]++;
+    c[1][v >> 8 & 0xff]++;
+    c[2][v >> 16 & 0xff]++;
+    c[3][v >> 24 & 0xff]++;
+    c[0][v >> 32 & 0xff]++;
+    c[1][v >> 40 & 0xff]++;
+    c[2][v >> 48 & 0xff]++;
+    c[3][v >> 56]++;
+  }
+  for(; i < n; i++) c[0][p[i]]++;
+  for(int b = 0; b < 256; b++) out[b] += (uint64_t)c[0][b] + c[1][b] + c[2][b] + c[3][b];
+}
+
+// histograms of whole blocks of one buffer
+struct StatsCache{
+  std::vector<std::unique_ptr<BlockCounts>> blocks;
+
+  // an edit that changes the size moves every block after it
+  void edited(size_t offset, size_t removed, size_t inserted){
+    size_t first = offset / STATS_BLOCK;
+    size_t last = removed == inserted ? (offset + removed + STATS_BLOCK-1) / STATS_BLOCK : blocks.size();
+    for(size_t b = first; b < std::min(last, blocks.size()); b++) blocks[b].reset();
+  }
+};
+
+// 4-grams counted in a table of 65536 slots holding one key each. A key
+// landing in a slot taken by another takes one off its count and moves in
+// once that reaches 0, Misra-Gries with a single counter per slot: a key
+// that's common next to the others hashing to its slot stays. Counts are
+// lower bounds
+struct GramTable{
+  std::vector<uint32_t> keys;
+  std::vector<uint32_t> counts;
+
+  GramTable(): keys(65536, 0), counts(65536, 0){}
+
+  void add(uint32_t key, uint32_t n = 1){
+    uint32_t slot = key * 2654435761u >> 16;
+    if(keys[slot] == key) counts[slot] += n;
+    else if(counts[slot] >= n) counts[slot] -= n;
+    else{
+      keys[slot] = key;
+      counts[slot] = n - counts[slot];
+    }
+  }
+
+  void merge(const GramTable& other){
+    for(size_t s = 0; s < 65536; s++) if(other.counts[s]) add(other.keys[s], other.counts[s]);
+  }
+};
+
+struct Gram{
+  uint64_t key; // first byte in the low bits
+  uint64_t count;
+};
+
+struct ByteStats{
+  uint64_t counts[256] = {};
+  uint64_t total = 0;
+  double entropy = 0; // bits per byte
+  double zeros = 0;
+  double printable = 0;
+  std::vector<Gram> bigrams;   // exact
+  std::vector<Gram> quadgrams; // lower bounds, in the first STATS_NGRAM_LIMIT bytes
+};
+
+const size_t STATS_CHUNK = 4 << 20;
+const size_t STATS_NGRAM_LIMIT = 64 << 20;
+const size_t STATS_TOP = 8;
+
+std::vector<Gram> topGrams(std::vector<Gram> grams){
+  size_t top = std::min(grams.size(), STATS_TOP);
+  std::partial_sort(grams.begin(), grams.begin()+top, grams.end(), [](const Gram& a, const Gram& b){
+    return a.count > b.count;
+  });
+  grams.resize(top);
+  return grams;
+}
+
+ByteStats byteStats(const ByteSource& source, size_t begin, size_t end, StatsCache& cache){
+  ByteStats stats;
+  stats.total = end - begin;
+  size_t blockCount = (source.size + STATS_BLOCK-1) / STATS_BLOCK;
+  if(cache.blocks.size() != blockCount) cache.blocks.resize(blockCount);
+
+  // whole blocks come from the cache, the ends are counted as they are
+  size_t firstBlock = (begin + STATS_BLOCK-1) / STATS_BLOCK;
+  size_t lastBlock = end / STATS_BLOCK;
+  std::vector<size_t> missing;
+  for(size_t b = firstBlock; b < lastBlock; b++) if(!cache.blocks[b]) missing.push_back(b);
+  parallelFor(missing.size(), [&](size_t m){
+    size_t b = missing[m];
+    size_t n = std::min(STATS_BLOCK, source.size - b*STATS_BLOCK);
+    std::string scratch;
+    uint64_t counts[256] = {};
+    countBytes((const uint8_t*)source.view(b*STATS_BLOCK, n, scratch), n, counts);
+    auto block = std::make_unique<BlockCounts>();
+    for(int v = 0; v < 256; v++) (*block)[v] = counts[v];
+    cache.blocks[b] = std::move(block);
+  });
+  for(size_t b = firstBlock; b < lastBlock; b++){
+    for(int v = 0; v < 256; v++) stats.counts[v] += (*cache.blocks[b])[v];
+  }
+  std::string scratch;
+  auto countRange = [&](size_t from, size_t to){
+    if(from < to) countBytes((const uint8_t*)source.view(from, to-from, scratch), to-from, stats.counts);
+  };
+  if(firstBlock >= lastBlock) countRange(begin, end);
+  else{
+    countRange(begin, firstBlock*STATS_BLOCK);
+    countRange(lastBlock*STATS_BLOCK, end);
+  }
+
+  uint64_t printable = 0;
+  for(int v = 0; v < 256; v++){
+    if(stats.counts[v] == 0) continue;
+    double p = (double)stats.counts[v] / stats.total;
+    stats.entropy -= p * std::log2(p);
+    if(isPrintable(v)) printable += stats.counts[v];
+  }
+  if(stats.total > 0){
+    stats.zeros = (double)stats.counts[0] / stats.total;
+    stats.printable = (double)printable / stats.total;
+  }
+
+  // pairs starting in each chunk, the chunk is viewed with the byte after it
+  size_t chunks = (stats.total + STATS_CHUNK-1) / STATS_CHUNK;
+  size_t quadEnd = std::min(end, begin + STATS_NGRAM_LIMIT);
+  std::vector<uint64_t> pairs(65536, 0);
+  std::vector<GramTable> quads(std::min(chunks, (STATS_NGRAM_LIMIT + STATS_CHUNK-1) / STATS_CHUNK));
+  std::mutex pairsLock;
+  parallelFor(chunks, [&](size_t c){
+    size_t from = begin + c*STATS_CHUNK;
+    size_t to = std::min(end, from + STATS_CHUNK);
+    size_t viewEnd = std::min(end, to + 3);
+    std::string scratch;
+    const uint8_t* p = (const uint8_t*)source.view(from, viewEnd-from, scratch);
+    std::vector<uint32_t> local(65536, 0);
+    for(size_t i = from; i+1 < viewEnd && i < to; i++) local[p[i-from] | p[i-from+1] << 8]++;
+    for(size_t i = from; i+3 < viewEnd && i < std::min(to, quadEnd); i++){
+      uint32_t key;
+      memcpy(&key, p + (i-from), 4);
+      quads[c].add(key);
+    }
+    std::lock_guard<std::mutex> lock(pairsLock);
+    for(size_t k = 0; k < 65536; k++) pairs[k] += local[k];
+  });
+  std::vector<Gram> grams;
+  for(size_t k = 0; k < 65536; k++) if(pairs[k]) grams.push_back({k, pairs[k]});
+  stats.bigrams = topGrams(grams);
+  grams.clear();
+  for(size_t c = 1; c < quads.size(); c++) quads[0].merge(quads[c]);
+  for(size_t s = 0; !quads.empty() && s < 65536; s++){
+    if(quads[0].counts[s]) grams.push_back({quads[0].keys[s], quads[0].counts[s]});
+  }
+  stats.quadgrams = topGrams(grams);
+  return stats;
+}
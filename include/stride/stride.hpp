@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+// Guesses the record length of files made of fixed size records. Bytes one
+// record apart tend to be the same (ids counting up, flags, padding), so the
+// share of p[i] == p[i+stride] is counted for every stride up to STRIDE_MAX.
+// Big files are only sampled, a few windows spread over the file, so it takes
+// the same time however big the file is.
+
+const size_t STRIDE_MAX = 2048;
+const size_t STRIDE_WINDOW = 16 << 10; // bytes compared per window and stride
+const size_t STRIDE_SAMPLES = 32;
+const size_t STRIDE_TOP = 8;
+
+// how many of a[i] == b[i] for i < n
+size_t countEqual(const uint8_t* a, const uint8_t* b, size_t n){
+  size_t count = 0;
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  while(i+16 <= n){
+    // a compare is -1 per equal byte, a lane can take 255 of them before it's summed
+    __m128i lanes = zero;
+    size_t stop = std::min(n & ~(size_t)15, i + 255*16);
+    for(; i < stop; i += 16){
+      __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+i)), _mm_loadu_si128((const __m128i*)(b+i)));
+      lanes = _mm_sub_epi8(lanes, eq);
+    }
+    __m128i sums = _mm_sad_epu8(lanes, zero);
+    count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+  }
+#endif
+  for(; i < n; i++) count += a[i] == b[i];
+  return count;
+}
+
+struct StrideGuess{
+  size_t stride;
+  double matches; // share of bytes equal to the one stride before
+  double score;   // how far above chance, 1 is every byte
+};
+
+std::vector<StrideGuess> detectStrides(const ByteSource& source){
+  std::vector<StrideGuess> guesses;
+  size_t reach = STRIDE_WINDOW + STRIDE_MAX;
+  size_t maxStride = std::min(STRIDE_MAX, source.size / 2);
+  if(maxStride < 2) return guesses;
+
+  // small files are one window over everything, compared as far as it goes
+  struct Window{
+    std::string scratch;
+    const uint8_t* p;
+    size_t size;
+  };
+  size_t windowCount = source.size <= STRIDE_SAMPLES*reach ? 1 : STRIDE_SAMPLES;
+  std::vector<Window> windows(windowCount);
+  uint64_t counts[256] = {};
+  uint64_t total = 0;
+  for(size_t w = 0; w < windowCount; w++){
+    Window& win = windows[w];
+    size_t offset = windowCount == 1 ? 0 : w * (source.size - reach) / (windowCount-1);
+    win.size = windowCount == 1 ? source.size : reach;
+    win.p = (const uint8_t*)source.view(offset, win.size, win.scratch);
+    for(size_t i = 0; i < win.size; i++) counts[win.p[i]]++;
+    total += win.size;
+  }
+  // two bytes picked at random are equal this often
+  double chance = 0;
+  for(int b = 0; b < 256; b++) chance += (double)counts[b] / total * counts[b] / total;
+  if(chance > 0.999) return guesses;
+
+  std::vector<double> matches(maxStride+1, 0);
+  const size_t block = 64;
+  parallelFor((maxStride+block) / block, [&](size_t t){
+    for(size_t s = std::max<size_t>(t*block, 1); s < std::min(maxStride+1, (t+1)*block); s++){
+      uint64_t equal = 0;
+      uint64_t compared = 0;
+      for(Window& win: windows){
+        size_t n = windowCount == 1 ? win.size - s : STRIDE_WINDOW;
+        equal += countEqual(win.p, win.p + s, n);
+        compared += n;
+      }
+      matches[s] = (double)equal / compared;
+    }
+  });
+  auto score = [&](size_t s){
+    return (matches[s] - chance) / (1 - chance);
+  };
+
+  // peaks, leaving out multiples of a stride that already explains them
+  for(size_t s = 2; s <= maxStride; s++){
+    double here = score(s);
+    if(here < 0.05 || here < score(s-1) || (s < maxStride && here < score(s+1))) continue;
+    bool multiple = false;
+    for(size_t d = 2; d*2 <= s && !multiple; d++){
+      multiple = s % d == 0 && score(d) >= here * 0.9;
+    }
+    if(!multiple) guesses.push_back({s, matches[s], here});
+  }
+  std::sort(guesses.begin(), guesses.end(), [](const StrideGuess& a, const StrideGuess& b){
+    return a.score > b.score;
+  });
+  if(guesses.size() > STRIDE_TOP) guesses.resize(STRIDE_TOP);
+  return guesses;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+// Printable ASCII runs and UTF-16LE runs (printable byte followed by a zero
+// byte), the same thing `strings` and `strings -el` print. Hits only keep
+// where the run is, the text is read back from the buffer when it's shown.
+struct StringHit{
+  uint64_t offset;
+  uint32_t length; // in characters
+  uint8_t wide;
+};
+
+bool isPrintable(uint8_t c){
+  return (c >= 0x20 && c <= 0x7e) || c == '\t';
+}
+
+// bit i of printable/zero is set if p[i] is printable/zero
+void classify64(const uint8_t* p, uint64_t& printable, uint64_t& zero){
+#ifdef __SSE2__
+  printable = 0;
+  zero = 0;
+  const __m128i bias = _mm_set1_epi8(0x60);
+  const __m128i limit = _mm_set1_epi8(-0x21);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i nul = _mm_setzero_si128();
+  for(int i = 0; i < 4; i++){
+    __m128i v = _mm_loadu_si128((const __m128i*)(p + i*16));
+    // c-0x20 < 0x5f unsigned, moved into signed range
+    __m128i pr = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+    pr = _mm_or_si128(pr, _mm_cmpeq_epi8(v, tab));
+    printable |= (uint64_t)(uint16_t)_mm_movemask_epi8(pr) << (i*16);
+    zero |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nul)) << (i*16);
+  }
+#else
+  printable = 0;
+  zero = 0;
+  for(int i = 0; i < 64; i++){
+    printable |= (uint64_t)isPrintable(p[i]) << i;
+    zero |= (uint64_t)(p[i] == 0) << i;
+  }
+#endif
+}
+
+struct StringsScanner{
+  const ByteSource* source;
+  size_t size;
+  size_t minLength;
+  std::vector<StringHit>* out;
+
+  // the chunk and one byte past it, anything else is read through source
+  const uint8_t* data;
+  size_t viewBegin;
+  size_t viewEnd;
+
+  uint8_t at(size_t i){
+    return i >= viewBegin && i < viewEnd ? data[i-viewBegin] : source->at(i);
+  }
+
+  // open run of each kind: ascii, wide at even offsets, wide at odd offsets.
+  // SKIP marks a run that started before the chunk, it belongs to the previous one
+  static const size_t NONE = SIZE_MAX;
+  static const size_t SKIP = SIZE_MAX-1;
+  size_t open[3];
+
+  bool wideAt(size_t i){
+    return i+1 < size && isPrintable(at(i)) && at(i+1) == 0;
+  }
+
+  void close(int kind, size_t end){
+    size_t start = open[kind];
+    open[kind] = NONE;
+    if(start == SKIP) return;
+    size_t length = kind == 0 ? end-start : (end-start)/2;
+    if(length >= minLength) out->push_back({start, (uint32_t)std::min<size_t>(length, UINT32_MAX), kind != 0});
+  }
+
+  // every set bit of edges is a run starting (bit also set in bits) or ending
+  void walk(int kind, uint64_t bits, uint64_t edges, size_t base){
+    while(edges){
+      int i = __builtin_ctzll(edges);
+      edges &= edges-1;
+      if(bits >> i & 1) open[kind] = base+i;
+      else close(kind, base+i);
+    }
+  }
+
+  void scan(size_t begin, size_t end){
+    std::string scratch;
+    viewBegin = begin;
+    viewEnd = std::min(end+1, size);
+    data = (const uint8_t*)source->view(begin, viewEnd-begin, scratch);
+
+    // kind 1 is wide runs at even offsets, kind 2 at odd ones
+    open[0] = begin > 0 && isPrintable(at(begin-1)) ? SKIP : NONE;
+    open[1 + begin%2] = begin >= 2 && wideAt(begin-2) ? SKIP : NONE;
+    open[1 + (begin+1)%2] = begin >= 1 && wideAt(begin-1) ? SKIP : NONE;
+
+    uint64_t prevAscii = open[0] != NONE;
+    uint64_t prevWide = (uint64_t)(open[1 + begin%2] != NONE) | (uint64_t)(open[1 + (begin+1)%2] != NONE) << 1;
+    // bits at even offsets, every block starts at begin + 64k
+    uint64_t even = begin%2 == 0 ? 0x5555555555555555ull : 0xaaaaaaaaaaaaaaaaull;
+
+    uint8_t tail[65];
+    for(size_t base = begin; base < end; base += 64){
+      const uint8_t* p = data+(base-begin);
+      size_t n = std::min<size_t>(64, end-base);
+      uint64_t valid = n < 64 ? (1ull << n)-1 : ~0ull;
+      if(base+65 > viewEnd){
+        memset(tail, 0xff, sizeof(tail));
+        memcpy(tail, p, viewEnd-base);
+        p = tail;
+      }
+      uint64_t printable, zero;
+      classify64(p, printable, zero);
+      uint64_t wide = printable & (zero >> 1 | (uint64_t)(p[64] == 0) << 63);
+
+      walk(0, printable, (printable ^ (printable << 1 | prevAscii)) & valid, base);
+      prevAscii = printable >> 63;
+
+      uint64_t wideEdges = (wide ^ (wide << 2 | prevWide)) & valid;
+      walk(1, wide & even, wideEdges & even, base);
+      walk(2, wide & ~even, wideEdges & ~even, base);
+      prevWide = wide >> 62;
+    }
+
+    // runs still open at the chunk end are finished here, reading past end
+    if(open[0] != NONE){
+      size_t i = end;
+      while(i < size && isPrintable(at(i))) i++;
+      close(0, i);
+    }
+    for(int kind = 1; kind < 3; kind++){
+      if(open[kind] == NONE) continue;
+      size_t i = end + (end%2 != (size_t)kind-1);
+      while(wideAt(i)) i += 2;
+      close(kind, i);
+    }
+  }
+};
+
+const size_t STRINGS_CHUNK = 1 << 20;
+
+std::vector<StringHit> extractStrings(const ByteSource& source, size_t minLength){
+  size_t size = source.size;
+  size_t chunks = (size + STRINGS_CHUNK-1) / STRINGS_CHUNK;
+  std::vector<std::vector<StringHit>> found(chunks);
+  parallelFor(chunks, [&](size_t c){
+    StringsScanner scanner{&source, size, std::max<size_t>(minLength, 1), &found[c]};
+    scanner.scan(c*STRINGS_CHUNK, std::min(size, (c+1)*STRINGS_CHUNK));
+    std::sort(found[c].begin(), found[c].end(), [](const StringHit& a, const StringHit& b){
+      return a.offset < b.offset;
+    });
+  });
+  std::vector<StringHit> hits;
+  size_t total = 0;
+  for(auto& f: found) total += f.size();
+  hits.reserve(total);
+  for(auto& f: found) hits.insert(hits.end(), f.begin(), f.end());
+  return hits;
+}
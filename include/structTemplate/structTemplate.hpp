@@ -0,0 +1,783 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <inspect/inspect.hpp>
+#include <span/span.hpp>
+
+// Describes a binary format as C-like structs, the first one is laid over
+// the start of the file:
+//
+//   struct file {
+//     char magic[4];
+//     u32 count;
+//     u32 tableOffset;
+//     entry entries[count];
+//     if(count > 0) u8 flags;
+//     @tableOffset u32be table[count];
+//   }
+//   struct entry {
+//     u16 kind;
+//     u16 length;
+//     if(kind == 2){ u8 data[length]; }
+//   }
+//
+// Types are u8..u64, i8..i64, f16, f32, f64, char and other structs, a be
+// suffix makes a number big endian. Fields follow each other unless they
+// start with @offset, those are placed there and take no room in the
+// struct. Counts, offsets and conditions are expressions over numbers and
+// the fields before, looked up in the enclosing structs too.
+//
+// Nothing is read up front. A node is only made when the tree or the hex
+// view asks for it, and arrays of fixed size elements are indexed without
+// looking at the elements before. Elements nothing is expanded in are
+// dropped again once enough have piled up.
+
+struct TemplatePrimitive{
+  const char* name;
+  size_t size;
+  bool isSigned;
+  bool isFloat;
+  int (*format)(const uint8_t* p, size_t avail, bool bigEndian, char* out, size_t n);
+};
+
+int formatChar(const uint8_t* p, size_t avail, bool bigEndian, char* out, size_t n){
+  if(p[0] >= 0x20 && p[0] <= 0x7e) return snprintf(out, n, "'%c'", p[0]);
+  return snprintf(out, n, "'\\x%02x'", p[0]);
+}
+
+const TemplatePrimitive templatePrimitives[] = {
+  {"u8",   1, false, false, formatValue<uint8_t>},
+  {"i8",   1, true,  false, formatValue<int8_t>},
+  {"u16",  2, false, false, formatValue<uint16_t>},
+  {"i16",  2, true,  false, formatValue<int16_t>},
+  {"u32",  4, false, false, formatValue<uint32_t>},
+  {"i32",  4, true,  false, formatValue<int32_t>},
+  {"u64",  8, false, false, formatValue<uint64_t>},
+  {"i64",  8, true,  false, formatValue<int64_t>},
+  {"f16",  2, true,  true,  formatValue<Half>},
+  {"f32",  4, true,  true,  formatValue<float>},
+  {"f64",  8, true,  true,  formatValue<double>},
+  {"char", 1, false, false, formatChar},
+};
+const int TEMPLATE_CHAR = sizeof(templatePrimitives)/sizeof(templatePrimitives[0]) - 1;
+
+struct TemplateExpr{
+  enum Type{
+    NUMBER,
+    NAME,
+    UNARY,
+    BINARY,
+  } type;
+  int op;
+  int64_t value;
+  std::string name;
+  int a, b;
+};
+
+// two character operators, the rest are their own character
+enum{
+  OP_SHL = 256,
+  OP_SHR,
+  OP_EQ,
+  OP_NE,
+  OP_LE,
+  OP_GE,
+  OP_AND,
+  OP_OR,
+};
+
+struct TemplateField{
+  std::string name;
+  std::string typeName;
+  int primitive = -1; // index into templatePrimitives, -1 for a struct
+  int structIndex = -1;
+  bool bigEndian = false;
+  int count = -1;     // expression, -1 if not an array
+  int at = -1;        // expression, -1 to follow the field before
+  int condition = -1; // expression, -1 if always there
+  int line;
+};
+
+struct TemplateStruct{
+  std::string name;
+  std::vector<TemplateField> fields;
+  int64_t fixedSize = -1; // -1 if it depends on the data
+};
+
+struct TemplateParser{
+  std::string_view p;
+  size_t i = 0;
+  int line = 1;
+  std::vector<TemplateStruct>& structs;
+  std::vector<TemplateExpr>& exprs;
+  std::string error;
+
+  bool fail(const char* msg){
+    if(error.empty()) error = "line " + std::to_string(line) + ": " + msg;
+    return false;
+  }
+
+  void skipSpace(){
+    while(i < p.size()){
+      if(p[i] == '\n') line++;
+      if(p[i] == ' ' || p[i] == '\t' || p[i] == '\r' || p[i] == '\n') i++;
+      else if(p.substr(i, 2) == "//") while(i < p.size() && p[i] != '\n') i++;
+      else break;
+    }
+  }
+
+  bool isIdent(char c, bool first){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (!first && c >= '0' && c <= '9');
+  }
+
+  // next character, whitespace skipped
+  char peek(){
+    skipSpace();
+    return i < p.size() ? p[i] : 0;
+  }
+
+  bool accept(std::string_view s){
+    skipSpace();
+    if(p.substr(i, s.size()) != s) return false;
+    // a keyword has to end there
+    if(isIdent(s[0], true) && i+s.size() < p.size() && isIdent(p[i+s.size()], false)) return false;
+    i += s.size();
+    return true;
+  }
+
+  bool expect(std::string_view s, const char* msg){
+    return accept(s) || fail(msg);
+  }
+
+  bool ident(std::string& out){
+    skipSpace();
+    if(i >= p.size() || !isIdent(p[i], true)) return false;
+    size_t start = i;
+    while(i < p.size() && isIdent(p[i], false)) i++;
+    out = p.substr(start, i-start);
+    return true;
+  }
+
+  int expr(TemplateExpr e){
+    exprs.push_back(e);
+    return exprs.size()-1;
+  }
+
+  int parsePrimary(){
+    char c = peek();
+    if(c == '('){
+      i++;
+      int e = parseExpr(0);
+      if(e < 0) return -1;
+      return accept(")") ? e : (fail("Expected )"), -1);
+    }
+    if(c == '-' || c == '!' || c == '~'){
+      i++;
+      int a = parsePrimary();
+      return a < 0 ? -1 : expr({TemplateExpr::UNARY, c, 0, "", a, -1});
+    }
+    if(c >= '0' && c <= '9'){
+      size_t used = 0;
+      int64_t v;
+      try{
+        v = std::stoll(std::string(p.substr(i, 24)), &used, 0);
+      }
+      catch(std::exception& e){
+        fail("Bad number");
+        return -1;
+      }
+      i += used;
+      return expr({TemplateExpr::NUMBER, 0, v});
+    }
+    std::string name;
+    if(ident(name)) return expr({TemplateExpr::NAME, 0, 0, name});
+    fail("Expected an expression");
+    return -1;
+  }
+
+  // binary operator at i and how tightly it binds, 0 if there isn't one
+  int binaryOp(int& op, size_t& length){
+    static const struct{ const char* s; int op; int level; } ops[] = {
+      {"||", OP_OR, 1}, {"&&", OP_AND, 2}, {"==", OP_EQ, 6}, {"!=", OP_NE, 6},
+      {"<=", OP_LE, 7}, {">=", OP_GE, 7}, {"<<", OP_SHL, 8}, {">>", OP_SHR, 8},
+      {"|", '|', 3}, {"^", '^', 4}, {"&", '&', 5}, {"<", '<', 7}, {">", '>', 7},
+      {"+", '+', 9}, {"-", '-', 9}, {"*", '*', 10}, {"/", '/', 10}, {"%", '%', 10},
+    };
+    skipSpace();
+    for(auto& o: ops){
+      if(p.substr(i, strlen(o.s)) == o.s){
+        op = o.op;
+        length = strlen(o.s);
+        return o.level;
+      }
+    }
+    return 0;
+  }
+
+  int parseExpr(int minLevel){
+    int left = parsePrimary();
+    while(left >= 0){
+      int op;
+      size_t length;
+      int level = binaryOp(op, length);
+      if(level == 0 || level <= minLevel) break;
+      i += length;
+      int right = parseExpr(level);
+      if(right < 0) return -1;
+      left = expr({TemplateExpr::BINARY, op, 0, "", left, right});
+    }
+    return left;
+  }
+
+  int both(int a, int b){
+    if(a < 0) return b;
+    return expr({TemplateExpr::BINARY, OP_AND, 0, "", a, b});
+  }
+
+  // one field or an if with its fields, condition is what has to hold for them
+  bool parseField(TemplateStruct& s, int condition){
+    if(accept("if")){
+      if(!expect("(", "Expected ( after if")) return false;
+      int c = parseExpr(0);
+      if(c < 0 || !expect(")", "Expected )")) return false;
+      c = both(condition, c);
+      if(!accept("{")) return parseField(s, c);
+      while(!accept("}")){
+        if(peek() == 0) return fail("Missing }");
+        if(!parseField(s, c)) return false;
+      }
+      return true;
+    }
+    TemplateField f;
+    f.line = line;
+    f.condition = condition;
+    if(accept("@") && (f.at = parseExpr(0)) < 0) return false;
+    if(!ident(f.typeName)) return fail("Expected a type");
+    if(!ident(f.name)) return fail("Expected a field name");
+    if(accept("[")){
+      f.count = parseExpr(0);
+      if(f.count < 0 || !expect("]", "Expected ]")) return false;
+    }
+    if(!expect(";", "Expected ;")) return false;
+    s.fields.push_back(f);
+    return true;
+  }
+
+  bool parse(){
+    while(peek() != 0){
+      TemplateStruct s;
+      if(!expect("struct", "Expected struct")) return false;
+      if(!ident(s.name)) return fail("Expected a struct name");
+      if(!expect("{", "Expected {")) return false;
+      while(!accept("}")){
+        if(peek() == 0) return fail("Missing }");
+        if(!parseField(s, -1)) return false;
+      }
+      accept(";");
+      structs.push_back(s);
+    }
+    if(structs.empty()) return fail("No structs");
+    return true;
+  }
+};
+
+struct LayoutNode{
+  int parent;
+  const TemplateField* field; // nullptr for the root
+  int64_t index;              // element of an array, -1 otherwise
+  bool isArray;
+  uint64_t offset;
+  uint64_t count = 0;         // arrays
+  uint64_t size = UINT64_MAX; // UINT64_MAX until it's known
+  int depth;
+  bool parsed = false;
+  bool expanded = false;
+  const char* error = nullptr;
+  uint64_t extra = 0;                // tree rows under it besides its fields or elements
+  std::vector<int> children;         // structs: their fields, made all at once
+  int last = -1;                     // structs: last child that isn't placed with @
+  std::map<uint64_t, int> elements;  // arrays: elements made since the last compact
+  std::map<uint64_t, int> open;      // arrays: elements taking more than one row
+  std::vector<uint64_t> offsets;     // arrays of elements that vary in size: starts found so far
+};
+
+const uint64_t LAYOUT_UNKNOWN = UINT64_MAX;
+const size_t LAYOUT_SLACK = 4096; // nodes made past twice what's kept before they're compacted
+
+struct Layout{
+  std::vector<TemplateStruct> structs;
+  std::vector<TemplateExpr> exprs;
+  std::deque<LayoutNode> nodes; // a deque so nodes stay put while more are added
+  std::string error;
+  ByteSource source;
+  uint64_t version = 0;
+  int selected = -1;
+  size_t kept = 1; // nodes left by the last compact
+
+  bool compile(std::string_view text){
+    TemplateParser parser{text, 0, 1, structs, exprs};
+    if(!parser.parse()){
+      error = parser.error;
+      return false;
+    }
+    for(TemplateStruct& s: structs){
+      for(TemplateField& f: s.fields){
+        std::string name = f.typeName;
+        if(name.size() > 2 && name.substr(name.size()-2) == "be"){
+          f.bigEndian = true;
+          name.resize(name.size()-2);
+        }
+        for(int t = 0; t <= TEMPLATE_CHAR; t++) if(name == templatePrimitives[t].name) f.primitive = t;
+        for(size_t t = 0; f.primitive < 0 && t < structs.size(); t++) if(f.typeName == structs[t].name) f.structIndex = t;
+        if(f.primitive < 0 && f.structIndex < 0){
+          error = "line " + std::to_string(f.line) + ": Unknown type " + f.typeName;
+          return false;
+        }
+      }
+    }
+    std::vector<int> state(structs.size(), 0);
+    for(size_t s = 0; s < structs.size(); s++) fixedSize(s, state);
+    return true;
+  }
+
+  // size of a struct when it's the same for any data, state guards against recursion
+  int64_t fixedSize(int s, std::vector<int>& state){
+    if(state[s] == 2) return structs[s].fixedSize;
+    if(state[s] == 1) return -1;
+    state[s] = 1;
+    int64_t size = 0;
+    for(TemplateField& f: structs[s].fields){
+      int64_t element = f.primitive >= 0 ? templatePrimitives[f.primitive].size : fixedSize(f.structIndex, state);
+      bool constant = f.count < 0 || exprs[f.count].type == TemplateExpr::NUMBER;
+      if(element < 0 || !constant || f.condition >= 0 || f.at >= 0){
+        size = -1;
+        break;
+      }
+      size += element * (f.count < 0 ? 1 : std::max<int64_t>(exprs[f.count].value, 0));
+    }
+    state[s] = 2;
+    structs[s].fixedSize = size;
+    return size;
+  }
+
+  // drops every node if the buffer changed since they were made
+  void use(ByteSource s, uint64_t bufferVersion){
+    source = s;
+    if(!nodes.empty() && version == bufferVersion){
+      if(nodes.size() > 2*kept + LAYOUT_SLACK) compact();
+      return;
+    }
+    version = bufferVersion;
+    nodes.clear();
+    nodes.push_back(LayoutNode{-1, nullptr, -1, false, 0});
+    nodes[0].depth = 0;
+    nodes[0].expanded = true;
+    selected = -1;
+    kept = 1;
+  }
+
+  // Drops array elements that aren't expanded, selected or above one that
+  // is, with everything under them. Scrolling through a long array makes
+  // its elements one by one, they're made again if they're looked at again
+  void compact(){
+    std::vector<bool> keep(nodes.size(), false);
+    for(size_t n = 0; n < nodes.size(); n++){
+      if(n != 0 && !nodes[n].expanded && (int)n != selected) continue;
+      for(int a = n; a >= 0 && !keep[a]; a = nodes[a].parent) keep[a] = true;
+    }
+    // a struct has all of its fields or none, parents come before children
+    for(size_t n = 1; n < nodes.size(); n++){
+      if(nodes[n].index < 0 && keep[nodes[n].parent]) keep[n] = true;
+    }
+    std::vector<int> moved(nodes.size(), -1);
+    std::deque<LayoutNode> left;
+    for(size_t n = 0; n < nodes.size(); n++){
+      if(!keep[n]) continue;
+      moved[n] = left.size();
+      left.push_back(std::move(nodes[n]));
+    }
+    for(LayoutNode& node: left){
+      if(node.parent >= 0) node.parent = moved[node.parent];
+      for(int& c: node.children) c = moved[c];
+      if(node.last >= 0) node.last = moved[node.last];
+      std::map<uint64_t, int> elements;
+      for(auto& [i, e]: node.elements) if(keep[e]) elements[i] = moved[e];
+      node.elements = std::move(elements);
+      for(auto& [i, e]: node.open) e = moved[e];
+    }
+    if(selected >= 0) selected = moved[selected];
+    nodes = std::move(left);
+    kept = nodes.size();
+  }
+
+  int structOf(int n){
+    return nodes[n].field ? nodes[n].field->structIndex : 0;
+  }
+
+  int primitiveOf(int n){
+    return nodes[n].field ? nodes[n].field->primitive : -1;
+  }
+
+  // size of one element of field, -1 if elements differ
+  int64_t elementSize(const TemplateField* f){
+    return f && f->primitive >= 0 ? templatePrimitives[f->primitive].size : structs[f ? f->structIndex : 0].fixedSize;
+  }
+
+  bool isStruct(int n){
+    return !nodes[n].isArray && primitiveOf(n) < 0;
+  }
+
+  bool expandable(int n){
+    return !nodes[n].error && (isStruct(n) || (nodes[n].isArray && primitiveOf(n) != TEMPLATE_CHAR));
+  }
+
+  int add(int parent, const TemplateField* field, int64_t index, bool isArray, uint64_t offset){
+    LayoutNode node{parent, field, index, isArray, offset};
+    node.depth = nodes[parent].depth + 1;
+    if(node.depth > 64) node.error = "Nested too deep";
+    nodes.push_back(node);
+    return nodes.size()-1;
+  }
+
+  bool read(uint64_t offset, size_t size, uint8_t* out){
+    if(offset > source.size || source.size - offset < size) return false;
+    for(size_t b = 0; b < size; b++) out[b] = source.at(offset+b);
+    return true;
+  }
+
+  bool number(int n, int64_t& out){
+    int t = primitiveOf(n);
+    if(t < 0 || nodes[n].isArray || nodes[n].error) return false;
+    const TemplatePrimitive& prim = templatePrimitives[t];
+    uint8_t b[8];
+    if(!read(nodes[n].offset, prim.size, b)) return false;
+    bool big = nodes[n].field->bigEndian;
+    if(prim.isFloat){
+      double v = prim.size == 2 ? halfToFloat(load<uint16_t>(b, big)) : prim.size == 4 ? load<float>(b, big) : load<double>(b, big);
+      out = (int64_t)v;
+      return true;
+    }
+    uint64_t v = prim.size == 1 ? b[0] : prim.size == 2 ? load<uint16_t>(b, big) : prim.size == 4 ? load<uint32_t>(b, big) : load<uint64_t>(b, big);
+    if(prim.isSigned && prim.size < 8 && v >> (prim.size*8-1)) v |= ~0ull << (prim.size*8);
+    out = v;
+    return true;
+  }
+
+  // field called name in scope or the structs around it
+  bool lookup(const std::string& name, int scope, int64_t& out){
+    for(int s = scope; s >= 0; s = nodes[s].parent){
+      if(!isStruct(s)) continue;
+      auto& children = nodes[s].children;
+      for(size_t c = children.size(); c-- > 0;){
+        if(nodes[children[c]].field->name == name) return number(children[c], out);
+      }
+    }
+    return false;
+  }
+
+  bool eval(int e, int scope, int64_t& out){
+    const TemplateExpr& x = exprs[e];
+    switch(x.type){
+      case TemplateExpr::NUMBER: out = x.value; return true;
+      case TemplateExpr::NAME: return lookup(x.name, scope, out);
+      case TemplateExpr::UNARY: {
+        if(!eval(x.a, scope, out)) return false;
+        out = x.op == '-' ? -out : x.op == '!' ? !out : ~out;
+        return true;
+      };
+      case TemplateExpr::BINARY: {
+        int64_t a, b;
+        if(!eval(x.a, scope, a)) return false;
+        // && and || don't look at the right side if they don't have to
+        if(x.op == OP_AND && !a){ out = 0; return true; }
+        if(x.op == OP_OR && a){ out = 1; return true; }
+        if(!eval(x.b, scope, b)) return false;
+        switch(x.op){
+          case '+': out = a + b; break;
+          case '-': out = a - b; break;
+          case '*': out = a * b; break;
+          case '/': if(b == 0) return false; out = a / b; break;
+          case '%': if(b == 0) return false; out = a % b; break;
+          case '&': out = a & b; break;
+          case '|': out = a | b; break;
+          case '^': out = a ^ b; break;
+          case '<': out = a < b; break;
+          case '>': out = a > b; break;
+          case OP_SHL: out = b >= 0 && b < 64 ? a << b : 0; break;
+          case OP_SHR: out = b >= 0 && b < 64 ? a >> b : 0; break;
+          case OP_EQ: out = a == b; break;
+          case OP_NE: out = a != b; break;
+          case OP_LE: out = a <= b; break;
+          case OP_GE: out = a >= b; break;
+          case OP_AND:
+          case OP_OR: out = b != 0; break;
+        }
+        return true;
+      };
+    }
+    return false;
+  }
+
+  // makes the fields of a struct node
+  void parse(int n){
+    if(nodes[n].parsed || nodes[n].error) return;
+    nodes[n].parsed = true;
+    const TemplateStruct& st = structs[structOf(n)];
+    for(const TemplateField& f: st.fields){
+      int64_t v;
+      if(f.condition >= 0){
+        if(!eval(f.condition, n, v)){
+          nodes[n].error = "Condition can't be worked out";
+          return;
+        }
+        if(!v) continue;
+      }
+      uint64_t offset;
+      if(f.at >= 0){
+        if(!eval(f.at, n, v) || v < 0){
+          nodes[n].error = "Bad offset";
+          return;
+        }
+        offset = v;
+      }
+      else{
+        int last = nodes[n].last;
+        uint64_t size = last < 0 ? 0 : sizeOf(last);
+        if(size == LAYOUT_UNKNOWN){
+          nodes[n].error = "Size of a field is unknown";
+          return;
+        }
+        offset = last < 0 ? nodes[n].offset : nodes[last].offset + size;
+      }
+      int c = add(n, &f, -1, f.count >= 0, offset);
+      if(f.count >= 0){
+        int64_t element = elementSize(&f);
+        uint64_t room = source.size > offset ? source.size - offset : 0;
+        if(!eval(f.count, n, v) || v < 0) nodes[c].error = "Bad count";
+        else if((uint64_t)v > room / std::max<int64_t>(element, 1)) nodes[c].error = "Runs past the end";
+        else{
+          nodes[c].count = v;
+          if(element < 0) nodes[c].offsets.push_back(offset);
+        }
+      }
+      else if(f.primitive >= 0 && offset + templatePrimitives[f.primitive].size > source.size){
+        nodes[c].error = "Past the end";
+      }
+      nodes[n].children.push_back(c);
+      if(f.at < 0) nodes[n].last = c;
+    }
+  }
+
+  uint64_t sizeOf(int n){
+    if(nodes[n].size != LAYOUT_UNKNOWN) return nodes[n].size;
+    if(nodes[n].error && !nodes[n].isArray) return LAYOUT_UNKNOWN;
+    uint64_t size = LAYOUT_UNKNOWN;
+    int64_t element = elementSize(nodes[n].field);
+    if(nodes[n].isArray){
+      if(nodes[n].error) return LAYOUT_UNKNOWN;
+      if(element >= 0) size = nodes[n].count * element;
+      else{
+        uint64_t end = elementOffset(n, nodes[n].count);
+        if(end != LAYOUT_UNKNOWN) size = end - nodes[n].offset;
+      }
+    }
+    else if(primitiveOf(n) >= 0 || element >= 0) size = element;
+    else{
+      parse(n);
+      if(nodes[n].error) return LAYOUT_UNKNOWN;
+      int last = nodes[n].last;
+      uint64_t lastSize = last < 0 ? 0 : sizeOf(last);
+      if(lastSize != LAYOUT_UNKNOWN) size = last < 0 ? 0 : nodes[last].offset + lastSize - nodes[n].offset;
+    }
+    nodes[n].size = size;
+    return size;
+  }
+
+  // where element i of an array starts, i == count gives the end
+  uint64_t elementOffset(int n, uint64_t i){
+    int64_t element = elementSize(nodes[n].field);
+    if(element >= 0) return nodes[n].offset + i*element;
+    while(nodes[n].offsets.size() <= i){
+      uint64_t k = nodes[n].offsets.size()-1;
+      uint64_t start = nodes[n].offsets[k];
+      auto it = nodes[n].elements.find(k);
+      uint64_t size;
+      if(it != nodes[n].elements.end()) size = sizeOf(it->second);
+      else{
+        // measured and thrown away again, walking a long array only keeps the offsets
+        size_t mark = nodes.size();
+        size = sizeOf(add(n, nodes[n].field, k, false, start));
+        nodes.resize(mark);
+      }
+      if(size == LAYOUT_UNKNOWN || start + size > source.size){
+        uint64_t before = rows(n);
+        nodes[n].error = "Element runs past the end";
+        resized(n, before);
+        return LAYOUT_UNKNOWN;
+      }
+      nodes[n].offsets.push_back(start + size);
+    }
+    return nodes[n].offsets[i];
+  }
+
+  int element(int n, uint64_t i){
+    auto it = nodes[n].elements.find(i);
+    if(it != nodes[n].elements.end()) return it->second;
+    uint64_t offset = elementOffset(n, i);
+    int e = add(n, nodes[n].field, i, false, offset == LAYOUT_UNKNOWN ? 0 : offset);
+    if(offset == LAYOUT_UNKNOWN) nodes[e].error = "Element runs past the end";
+    nodes[n].elements[i] = e;
+    return e;
+  }
+
+  // calls found for every number inside [from, to) under node n, char arrays
+  // count as one. parity alternates between neighbours
+  void leaves(int n, uint64_t from, uint64_t to, const std::function<void(uint64_t offset, uint64_t size, int parity)>& found, int parity = 0){
+    if(nodes[n].error) return;
+    uint64_t offset = nodes[n].offset;
+    int prim = primitiveOf(n);
+    if(!nodes[n].isArray && prim >= 0){
+      if(offset < to && offset + templatePrimitives[prim].size > from) found(offset, templatePrimitives[prim].size, parity);
+      return;
+    }
+    if(!nodes[n].isArray){
+      int64_t fixed = elementSize(nodes[n].field);
+      if(fixed >= 0 && (offset >= to || offset + fixed <= from)) return;
+      parse(n);
+      auto& children = nodes[n].children;
+      for(size_t c = 0; c < children.size(); c++) leaves(children[c], from, to, found, c & 1);
+      return;
+    }
+    uint64_t count = nodes[n].count;
+    if(count == 0 || offset >= to) return;
+    if(prim == TEMPLATE_CHAR){
+      if(offset + count > from) found(offset, count, parity);
+      return;
+    }
+    int64_t step = elementSize(nodes[n].field);
+    uint64_t first, last;
+    if(step > 0){
+      first = from > offset ? (from - offset) / step : 0;
+      last = std::min(count, (to - offset + step - 1) / step);
+    }
+    else if(step == 0) return;
+    else{
+      // the starts found so far are searched, past them they're found up to
+      // the window. Then the first one ending in it
+      auto& offsets = nodes[n].offsets;
+      last = std::lower_bound(offsets.begin(), offsets.begin() + std::min<uint64_t>(offsets.size(), count), to) - offsets.begin();
+      while(last < count){
+        uint64_t start = elementOffset(n, last);
+        if(start == LAYOUT_UNKNOWN || start >= to) break;
+        last++;
+      }
+      first = std::upper_bound(offsets.begin(), offsets.begin() + last, from) - offsets.begin();
+      first = first > 0 ? first-1 : 0;
+    }
+    for(uint64_t i = first; i < last; i++){
+      if(prim >= 0){
+        found(offset + i*step, step, i & 1);
+        continue;
+      }
+      leaves(element(n, i), from, to, found, i & 1);
+    }
+  }
+
+  // rows node n takes in the tree, itself and what's expanded under it
+  uint64_t rows(int n){
+    if(!nodes[n].expanded || !expandable(n)) return 1;
+    if(nodes[n].isArray) return 1 + nodes[n].count + nodes[n].extra;
+    parse(n);
+    if(nodes[n].error) return 1;
+    return 1 + nodes[n].children.size() + nodes[n].extra;
+  }
+
+  // n took before rows, the nodes above it take on the difference
+  void resized(int n, uint64_t before){
+    uint64_t after = rows(n);
+    for(int p = nodes[n].parent; p >= 0 && after != before; n = p, p = nodes[p].parent){
+      if(nodes[p].isArray){
+        if(after > 1) nodes[p].open[nodes[n].index] = n;
+        else nodes[p].open.erase(nodes[n].index);
+      }
+      uint64_t was = rows(p);
+      nodes[p].extra += after - before;
+      before = was;
+      after = rows(p);
+    }
+  }
+
+  void expand(int n, bool expanded){
+    if(isStruct(n)) parse(n);
+    if(expanded && !expandable(n)) return;
+    uint64_t before = rows(n);
+    nodes[n].expanded = expanded;
+    resized(n, before);
+  }
+
+  // node shown on row r of the tree under n
+  int rowNode(int n, uint64_t r){
+    if(r == 0) return n;
+    r--;
+    if(!nodes[n].isArray){
+      for(int c: nodes[n].children){
+        uint64_t taken = rows(c);
+        if(r < taken) return rowNode(c, r);
+        r -= taken;
+      }
+      return n;
+    }
+    // rows before element i are i plus the extra rows of the expanded ones before it
+    uint64_t extra = 0;
+    for(auto& [i, e]: nodes[n].open){
+      uint64_t taken = rows(e);
+      if(r < i + extra) break;
+      if(r < i + extra + taken) return rowNode(e, r - i - extra);
+      extra += taken - 1;
+    }
+    return element(n, r - extra);
+  }
+
+  // one line of the tree for node n
+  void describe(int n, char* out, size_t size){
+    const TemplateField* f = nodes[n].field;
+    std::string name = !f ? structs[0].name : nodes[n].index >= 0 ? "[" + std::to_string(nodes[n].index) + "]" : f->name;
+    int used = snprintf(out, size, "%*s%c %s", nodes[n].depth*2, "", expandable(n) ? (nodes[n].expanded ? '-' : '+') : ' ', name.data());
+    auto more = [&](const char* fmt, auto... args){
+      if(used >= 0 && (size_t)used < size) used += snprintf(out+used, size-used, fmt, args...);
+    };
+    if(f && (nodes[n].isArray || nodes[n].index < 0)) more(" %s", f->typeName.data());
+    if(nodes[n].isArray) more("[%llu]", (unsigned long long)nodes[n].count);
+    more(" @0x%llx", (unsigned long long)nodes[n].offset);
+    if(nodes[n].error){
+      more("  ! %s", nodes[n].error);
+      return;
+    }
+    int prim = primitiveOf(n);
+    if(nodes[n].isArray && prim == TEMPLATE_CHAR){
+      more("  \"");
+      for(uint64_t c = 0; c < std::min<uint64_t>(nodes[n].count, 48); c++){
+        uint8_t ch = source.at(nodes[n].offset + c);
+        more("%c", ch >= 0x20 && ch <= 0x7e ? ch : '.');
+      }
+      more(nodes[n].count > 48 ? "...\"" : "\"");
+    }
+    else if(!nodes[n].isArray && prim >= 0){
+      uint8_t b[8];
+      char value[40];
+      if(!read(nodes[n].offset, templatePrimitives[prim].size, b)) return;
+      templatePrimitives[prim].format(b, 8, f->bigEndian, value, sizeof(value));
+      more("  = %s", value);
+    }
+  }
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORM_X86 1
+#endif
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+// Bulk rewrites of a selection: fills, repeating keys and byte reorders.
+// Output is always the size of the input, so the range is cut into chunks
+// that run on every core. Keys repeat from the start of the selection and a
+// chunk only needs to know where in the key it starts.
+
+const size_t TRANSFORM_CHUNK = 1 << 20; // a multiple of every group size
+const size_t TRANSFORM_KEY_MAX = 4096;
+
+// The key repeated to a multiple of 16 bytes plus 16 more, so a vector can
+// be loaded at any position before period without wrapping around
+struct KeyStream{
+  std::string bytes;
+  size_t period = 0;
+
+  void init(const std::string& key){
+    period = key.size();
+    while(period % 16) period += key.size();
+    bytes.resize(period + 16);
+    for(size_t i = 0; i < bytes.size(); i++) bytes[i] = key[i % key.size()];
+  }
+};
+
+enum KeyOp{ KEY_XOR, KEY_ADD, KEY_SUB };
+
+template<KeyOp op>
+void keyed(const uint8_t* in, uint8_t* out, size_t n, const KeyStream& key, size_t phase){
+  const uint8_t* k = (const uint8_t*)key.bytes.data();
+  size_t i = 0;
+#ifdef __SSE2__
+  for(; i+16 <= n; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(in+i));
+    __m128i kv = _mm_loadu_si128((const __m128i*)(k+phase));
+    if constexpr(op == KEY_XOR) v = _mm_xor_si128(v, kv);
+    else if constexpr(op == KEY_ADD) v = _mm_add_epi8(v, kv);
+    else v = _mm_sub_epi8(v, kv);
+    _mm_storeu_si128((__m128i*)(out+i), v);
+    phase += 16;
+    if(phase >= key.period) phase -= key.period;
+  }
+#endif
+  for(; i < n; i++){
+    if constexpr(op == KEY_XOR) out[i] = in[i] ^ k[phase];
+    else if constexpr(op == KEY_ADD) out[i] = in[i] + k[phase];
+    else out[i] = in[i] - k[phase];
+    if(++phase == key.period) phase = 0;
+  }
+}
+
+void fillPattern(const uint8_t* in, uint8_t* out, size_t n, const KeyStream& key, size_t phase){
+  while(n > 0){
+    size_t take = std::min(n, key.period - phase);
+    memcpy(out, key.bytes.data() + phase, take);
+    out += take;
+    n -= take;
+    phase = 0;
+  }
+}
+
+uint8_t reverseBits(uint8_t b){
+  b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+  b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+  return (b & 0xaa) >> 1 | (b & 0x55) << 1;
+}
+
+void swapNibbles(const uint8_t* in, uint8_t* out, size_t n, const KeyStream& key, size_t phase){
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i low = _mm_set1_epi8(0x0f);
+  for(; i+16 <= n; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(in+i));
+    __m128i swapped = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), low), _mm_slli_epi16(_mm_and_si128(v, low), 4));
+    _mm_storeu_si128((__m128i*)(out+i), swapped);
+  }
+#endif
+  for(; i < n; i++) out[i] = in[i] >> 4 | in[i] << 4;
+}
+
+#ifdef TRANSFORM_X86
+// pshufb does both: a byte shuffle for the swaps and a 16 entry table
+// lookup per nibble for the bit reverse
+template<size_t group>
+__attribute__((target("ssse3")))
+size_t swapBytesSsse3(const uint8_t* in, uint8_t* out, size_t n){
+  uint8_t order[16];
+  for(size_t b = 0; b < 16; b++) order[b] = b - b % group + (group-1 - b % group);
+  const __m128i shuffle = _mm_loadu_si128((const __m128i*)order);
+  size_t i = 0;
+  for(; i+16 <= n; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(in+i));
+    _mm_storeu_si128((__m128i*)(out+i), _mm_shuffle_epi8(v, shuffle));
+  }
+  return i;
+}
+
+__attribute__((target("ssse3")))
+size_t reverseBitsSsse3(const uint8_t* in, uint8_t* out, size_t n){
+  uint8_t table[16];
+  for(int b = 0; b < 16; b++) table[b] = reverseBits(b) >> 4;
+  const __m128i reversed = _mm_loadu_si128((const __m128i*)table);
+  const __m128i low = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for(; i+16 <= n; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(in+i));
+    __m128i lo = _mm_shuffle_epi8(reversed, _mm_and_si128(v, low));
+    __m128i hi = _mm_shuffle_epi8(reversed, _mm_and_si128(_mm_srli_epi16(v, 4), low));
+    _mm_storeu_si128((__m128i*)(out+i), _mm_or_si128(_mm_slli_epi16(lo, 4), hi));
+  }
+  return i;
+}
+#endif
+
+// a trailing part too short for a whole group stays as it is
+template<size_t group>
+void swapBytes(const uint8_t* in, uint8_t* out, size_t n, const KeyStream& key, size_t phase){
+  size_t i = 0;
+#ifdef TRANSFORM_X86
+  static const bool fast = __builtin_cpu_supports("ssse3");
+  if(fast) i = swapBytesSsse3<group>(in, out, n);
+#endif
+  for(; i+group <= n; i += group){
+    for(size_t b = 0; b < group; b++) out[i+b] = in[i + group-1-b];
+  }
+  memcpy(out+i, in+i, n-i);
+}
+
+void reverseBitsOf(const uint8_t* in, uint8_t* out, size_t n, const KeyStream& key, size_t phase){
+  size_t i = 0;
+#ifdef TRANSFORM_X86
+  static const bool fast = __builtin_cpu_supports("ssse3");
+  if(fast) i = reverseBitsSsse3(in, out, n);
+#endif
+  for(; i < n; i++) out[i] = reverseBits(in[i]);
+}
+
+struct Transform{
+  const char* name;
+  bool keyed; // takes a key or pattern after the name
+  void (*apply)(const uint8_t* in, uint8_t* out, size_t n, const KeyStream& key, size_t phase);
+};
+
+const Transform transforms[] = {
+  {"fill",    true,  fillPattern},
+  {"xor",     true,  keyed<KEY_XOR>},
+  {"add",     true,  keyed<KEY_ADD>},
+  {"sub",     true,  keyed<KEY_SUB>},
+  {"bswap16", false, swapBytes<2>},
+  {"bswap32", false, swapBytes<4>},
+  {"bswap64", false, swapBytes<8>},
+  {"bitrev",  false, reverseBitsOf},
+  {"nibbles", false, swapNibbles},
+};
+const size_t transformCount = sizeof(transforms)/sizeof(transforms[0]);
+
+const Transform* findTransform(std::string_view name){
+  for(const Transform& t: transforms) if(name == t.name) return &t;
+  return nullptr;
+}
+
+// n bytes of source at begin, transformed into out. done counts the bytes
+// transformed, false if cancel was set before all of them were
+bool transformRange(const ByteSource& source, size_t begin, size_t n, const Transform& transform, const KeyStream& key, char* out, std::atomic<uint64_t>& done, const std::atomic<bool>& cancel, size_t threads = workerCount()){
+  parallelFor((n + TRANSFORM_CHUNK-1) / TRANSFORM_CHUNK, [&](size_t c){
+    if(cancel) return;
+    size_t from = c*TRANSFORM_CHUNK;
+    size_t size = std::min(TRANSFORM_CHUNK, n - from);
+    std::string scratch;
+    const uint8_t* in = (const uint8_t*)source.view(begin + from, size, scratch);
+    transform.apply(in, (uint8_t*)out + from, size, key, key.period ? from % key.period : 0);
+    done += size;
+  }, threads);
+  return !cancel;
+}
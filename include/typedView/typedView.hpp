@@ -0,0 +1,55 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+
+#include <inspect/inspect.hpp>
+
+// Rows of a file shown as numbers instead of bytes. Only rows on screen are
+// ever decoded, a whole row at a time: first all the loads into an array,
+// which is a plain loop the compiler can vectorize, then to_chars for each,
+// which gives the shortest text that reads back as the same float.
+
+const size_t TYPED_CELL = 25; // longest is a negative double with a 3 digit exponent
+
+template<typename T>
+void decodeRow(const uint8_t* p, size_t count, bool bigEndian, T* out){
+  for(size_t i = 0; i < count; i++) out[i] = load<T>(p + i*sizeof(T), bigEndian);
+}
+
+// formats count values from p into cells, lengths gets how long each one is
+template<typename T>
+void formatRow(const uint8_t* p, size_t count, bool bigEndian, char (*cells)[TYPED_CELL], uint8_t* lengths){
+  T values[64];
+  while(count > 0){
+    size_t n = std::min<size_t>(count, 64);
+    decodeRow(p, n, bigEndian, values);
+    for(size_t i = 0; i < n; i++){
+      lengths[i] = std::to_chars(cells[i], cells[i] + TYPED_CELL, values[i]).ptr - cells[i];
+    }
+    p += n*sizeof(T);
+    cells += n;
+    lengths += n;
+    count -= n;
+  }
+}
+
+struct ViewType{
+  const char* name;
+  size_t size;
+  int width; // widest value in characters
+  void (*format)(const uint8_t* p, size_t count, bool bigEndian, char (*cells)[TYPED_CELL], uint8_t* lengths);
+};
+
+// the first one is the usual hex view, it isn't formatted here
+const ViewType viewTypes[] = {
+  {"hex", 1, 2,  nullptr},
+  {"u16", 2, 5,  formatRow<uint16_t>},
+  {"i16", 2, 6,  formatRow<int16_t>},
+  {"u32", 4, 10, formatRow<uint32_t>},
+  {"i32", 4, 11, formatRow<int32_t>},
+  {"u64", 8, 20, formatRow<uint64_t>},
+  {"f32", 4, 14, formatRow<float>},
+  {"f64", 8, 24, formatRow<double>},
+};
+const size_t viewTypeCount = sizeof(viewTypes)/sizeof(viewTypes[0]);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include <pieceTable/pieceTable.hpp>
+
+// Edits are remembered as the pieces they replaced. Those keep pointing at
+// the same bytes forever, so an entry costs a few pieces however many bytes
+// an edit touched, and undoing it is just another splice.
+
+// size bytes at offset were pieces before the edit
+struct UndoStep{
+  size_t offset;
+  size_t size;
+  std::vector<Piece> pieces;
+};
+
+// steps of one entry are undone last to first
+typedef std::vector<UndoStep> UndoEntry;
+
+struct UndoHistory{
+  std::vector<UndoEntry> undo;
+  std::vector<UndoEntry> redo;
+  int depth = 0; // open transactions, edits in one are undone together
+  // Edits of a batch aren't recorded one by one. The pieces from before it
+  // are kept whole and cut down to the part that changed when it ends, so
+  // any number of edits becomes a single step
+  bool batch = false;
+  std::vector<Piece> before;
+
+  // called before data changes
+  void record(const PieceTable& data, size_t offset, size_t removed, size_t inserted){
+    if(batch) return;
+    if(depth == 0) undo.emplace_back();
+    undo.back().push_back({offset, inserted, data.slice(offset, removed)});
+    redo.clear();
+  }
+
+  void begin(){
+    if(depth++ == 0) undo.emplace_back();
+  }
+
+  void end(){
+    if(--depth == 0 && undo.back().empty()) undo.pop_back();
+  }
+
+  void beginBatch(const PieceTable& data){
+    before = data.pieces;
+    batch = true;
+  }
+
+  void endBatch(const PieceTable& data){
+    batch = false;
+    const std::vector<Piece>& after = data.pieces;
+    auto same = [](const Piece& a, const Piece& b){
+      return a.storage == b.storage && a.offset == b.offset && a.size == b.size;
+    };
+    size_t head = 0, offset = 0;
+    while(head < before.size() && head < after.size() && same(before[head], after[head])){
+      offset += before[head].size;
+      head++;
+    }
+    size_t tail = 0;
+    while(head+tail < before.size() && head+tail < after.size() && same(before[before.size()-1-tail], after[after.size()-1-tail])) tail++;
+    if(head+tail < before.size() || head+tail < after.size()){
+      size_t size = 0;
+      for(size_t i = head; i+tail < after.size(); i++) size += after[i].size;
+      undo.push_back({{offset, size, std::vector<Piece>(before.begin()+head, before.end()-tail)}});
+      redo.clear();
+    }
+    before = std::vector<Piece>();
+  }
+};
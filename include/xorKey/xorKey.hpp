@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <parallel/parallel.hpp>
+#include <span/span.hpp>
+
+// Finds short keys a range was xored with. For a key length L, byte i was
+// xored with key byte i % L, so every column of bytes L apart shares one key
+// byte. The byte that makes a column's histogram look most like plaintext is
+// taken as the key byte. Plaintext here is mostly zeros (the key shows
+// through runs of them as is), spaces and letters, so the guesses suit
+// padded binary formats as well as text.
+
+const size_t XOR_KEY_MAX = 64;
+const size_t XOR_SAMPLE = 1 << 20; // bytes from the start of the range
+const size_t XOR_TOP = 8;
+
+// how much a decoded byte looks like plaintext
+float plaintextWeight(uint8_t b){
+  if(b == 0 || b == ' ') return 3;
+  if(b >= 'a' && b <= 'z') return 2;
+  if((b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9')) return 1.5;
+  if((b > 0x20 && b < 0x7f) || b == '\n' || b == '\r' || b == '\t' || b == 0xff) return 1;
+  return 0;
+}
+
+// weights[k][b] is the weight of b decoded with key byte k
+struct XorWeights{
+  alignas(16) float weights[256][256];
+
+  XorWeights(){
+    for(int k = 0; k < 256; k++) for(int b = 0; b < 256; b++) weights[k][b] = plaintextWeight(b ^ k);
+  }
+};
+
+float dot256(const float* a, const float* b){
+#ifdef __SSE2__
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  for(int i = 0; i < 256; i += 8){
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_load_ps(a+i), _mm_load_ps(b+i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_load_ps(a+i+4), _mm_load_ps(b+i+4)));
+  }
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, _mm_add_ps(sum0, sum1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+  float sum = 0;
+  for(int i = 0; i < 256; i++) sum += a[i]*b[i];
+  return sum;
+#endif
+}
+
+struct XorGuess{
+  std::string key;
+  double score; // share of the best possible plaintext weight
+};
+
+std::vector<XorGuess> guessXorKeys(const ByteSource& source, size_t begin, size_t end){
+  static const XorWeights table;
+  std::vector<XorGuess> guesses;
+  size_t n = std::min(end - begin, XOR_SAMPLE);
+  size_t maxLength = std::min(XOR_KEY_MAX, n / 8);
+  if(maxLength == 0) return guesses;
+  std::string scratch;
+  const uint8_t* p = (const uint8_t*)source.view(begin, n, scratch);
+
+  std::vector<XorGuess> byLength(maxLength+1);
+  parallelFor(maxLength, [&](size_t t){
+    size_t length = t+1;
+    std::vector<uint32_t> counts(length*256, 0);
+    for(size_t i = 0, c = 0; i < n; i++){
+      counts[c*256 + p[i]]++;
+      if(++c == length) c = 0;
+    }
+    XorGuess& g = byLength[length];
+    g.key.resize(length);
+    float total = 0;
+    alignas(16) float column[256];
+    for(size_t c = 0; c < length; c++){
+      for(int b = 0; b < 256; b++) column[b] = counts[c*256 + b];
+      float best = -1;
+      for(int k = 0; k < 256; k++){
+        float s = dot256(column, table.weights[k]);
+        if(s > best){
+          best = s;
+          g.key[c] = k;
+        }
+      }
+      total += best;
+    }
+    g.score = total / (3.0 * n);
+  });
+
+  // a key and the same key twice decode the same, so a length only counts if
+  // it does clearly better than every length dividing it
+  for(size_t length = 1; length <= maxLength; length++){
+    bool repeats = false;
+    for(size_t d = 1; d*2 <= length && !repeats; d++){
+      repeats = length % d == 0 && byLength[d].score >= byLength[length].score - 0.02;
+    }
+    if(!repeats) guesses.push_back(byLength[length]);
+  }
+  std::sort(guesses.begin(), guesses.end(), [](const XorGuess& a, const XorGuess& b){
+    return a.score > b.score;
+  });
+  if(guesses.size() > XOR_TOP) guesses.resize(XOR_TOP);
+  return guesses;
+}
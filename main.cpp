@@ -1,15 +1,49 @@
 #include <algorithm>
 #include <cassert>
+#include <csignal>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
 #include <ncurses.h>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
+#include <bps/bps.hpp>
+#include <carve/carve.hpp>
+#include <checksum/checksum.hpp>
+#include <command/command.hpp>
+#include <diff/diff.hpp>
+#include <dump/dump.hpp>
+#include <encode/encode.hpp>
+#include <hexImport/hexImport.hpp>
+#include <inspect/inspect.hpp>
+#include <pieceTable/pieceTable.hpp>
 #include <readFile/readFile.hpp>
+#include <regex/regex.hpp>
+#include <script/script.hpp>
+#include <search/search.hpp>
+#include <session/session.hpp>
+#include <stats/stats.hpp>
+#include <stride/stride.hpp>
+#include <strings/strings.hpp>
+#include <structTemplate/structTemplate.hpp>
+#include <transform/transform.hpp>
+#include <typedView/typedView.hpp>
+#include <undo/undo.hpp>
+#include <xorKey/xorKey.hpp>
 
 enum{
   COLORPAIR_INV = 1,
   COLORPAIR_SEL,
   COLORPAIR_GRAY,
+  COLORPAIR_MARK,
+  COLORPAIR_HIT,
+  COLORPAIR_FIELD,
+  COLORPAIR_FIELD2,
+  COLORPAIR_DIFF,
 };
 
 enum{
@@ -22,27 +56,118 @@ void init_colors(){
   init_pair(COLORPAIR_INV, COLOR_BLACK, COLOR_WHITE);
   init_pair(COLORPAIR_SEL, COLOR_BLACK, COLOR_GRAY);
   init_pair(COLORPAIR_GRAY, COLOR_GRAY, COLOR_BLACK);
+  init_pair(COLORPAIR_MARK, COLOR_BLACK, COLOR_CYAN);
+  init_pair(COLORPAIR_HIT, COLOR_BLACK, COLOR_YELLOW);
+  init_pair(COLORPAIR_FIELD, COLOR_WHITE, COLOR_BLUE);
+  init_pair(COLORPAIR_FIELD2, COLOR_WHITE, COLOR_MAGENTA);
+  init_pair(COLORPAIR_DIFF, COLOR_WHITE, COLOR_RED);
 }
 
+// highlighted range with a short label drawn next to the row it starts in
+struct Annotation{
+  size_t offset;
+  size_t size;
+  const char* label;
+};
+
 struct File{
   std::string path;
-  std::string data;
+  PieceTable data;
+  std::vector<Annotation> annotations; // sorted by offset
+  size_t annotationMaxSize = 0;
+  ActiveSearch search;
+  std::unique_ptr<Layout> layout; // struct template laid over the file
+  StatsCache stats;
+  UndoHistory history;
   std::string name(){
     return path.substr(path.find_last_of('/')+1);
   }
-  File(){}
+  File(){
+    data.init("");
+  }
   File(std::string in_path){
     path = in_path;
-    data = readFile(path);
+    data.init(readFile(path));
+  }
+  void replace(size_t offset, size_t removed, const char* bytes, size_t inserted){
+    history.record(data, offset, removed, inserted);
+    data.replace(offset, removed, bytes, inserted);
+    edited(offset, removed, inserted);
+  }
+  // pieces of this or any other file, their bytes aren't copied
+  void splice(size_t offset, size_t removed, const std::vector<Piece>& pieces, size_t inserted){
+    history.record(data, offset, removed, inserted);
+    data.splice(offset, removed, pieces);
+    edited(offset, removed, inserted);
+  }
+  // undoes the last entry of from and files the way back in to, returns
+  // where the first step of it was or SIZE_MAX if there was nothing
+  size_t travel(std::vector<UndoEntry>& from, std::vector<UndoEntry>& to){
+    if(from.empty()) return SIZE_MAX;
+    UndoEntry entry = std::move(from.back());
+    from.pop_back();
+    UndoEntry back;
+    for(size_t s = entry.size(); s-- > 0;){
+      UndoStep& step = entry[s];
+      size_t inserted = 0;
+      for(Piece& p: step.pieces) inserted += p.size;
+      back.push_back({step.offset, inserted, data.slice(step.offset, step.size)});
+      data.splice(step.offset, step.size, step.pieces);
+      edited(step.offset, step.size, inserted);
+    }
+    to.push_back(std::move(back));
+    return entry[0].offset;
+  }
+  // every edit goes through here so the search and annotations keep up
+  void edited(size_t offset, size_t removed, size_t inserted){
+    search.edited(data.source(), offset, removed, inserted);
+    stats.edited(offset, removed, inserted);
+    if(removed == inserted) return;
+    std::vector<Annotation> kept;
+    for(Annotation& a: annotations){
+      if(removed > 0 && a.offset < offset+removed && offset < a.offset+a.size) continue;
+      if(a.offset >= offset+removed) a.offset = a.offset - removed + inserted;
+      kept.push_back(a);
+    }
+    annotations.swap(kept);
   }
 };
 std::vector<File> files;
 
+// differences between two files, only shown while neither was edited since
+struct Diff{
+  size_t a = SIZE_MAX, b;
+  uint64_t versionA, versionB;
+  DiffResult result;
+
+  bool active(){
+    return a != SIZE_MAX && files[a].data.version == versionA && files[b].data.version == versionB;
+  }
+
+  // the side of a range in file
+  void side(const DiffRange& r, size_t file, uint64_t& offset, uint64_t& size){
+    offset = file == a ? r.a : r.b;
+    size = file == a ? r.aSize : r.bSize;
+  }
+} diff;
+
+const uint16_t COLUMNS_MAX = 256;
+
 struct FileView{
   size_t i;
   size_t cursor;
+  size_t extent = 1; // bytes selected from the cursor on
   size_t scroll = 0;
   uint16_t columns = 16;
+  uint8_t type = 0; // index into viewTypes
+  bool bigEndian = false;
+  // key shown xored over the bytes from xorOrigin on, fixed size to keep this
+  // trivial for the union in Panel
+  uint8_t xorLength = 0;
+  char xorKey[XOR_KEY_MAX];
+  size_t xorOrigin = 0;
+  uint8_t link = 0; // views in the same group 1-9 move together
+  size_t linkAnchor; // cursor when it was linked, the others keep their distance to it
 };
 
 struct Panel{
@@ -57,12 +182,109 @@ std::vector<Panel> panelTree;
 struct Context{
   size_t focus;
   uint16_t scrollPadding = 5;
+  std::string status;
+  bool editMode = false;
+  bool lowNibble = false; // next hex digit typed goes into the low nibble
+  bool inspector = false;
+  bool quit = false;
+  // bumped by every key that can change more than where cursors are, so
+  // rows of the file views get drawn again
+  uint64_t paintGeneration = 0;
 } ctx;
 
+const size_t MACRO_POLL = 1 << 16; // replayed keys between looks for esc
+
+// Keys recorded with Q. A replay feeds them back through readKey instead of
+// the terminal and nothing is drawn until it ends, so a run costs about what
+// the edits in it do
+struct Macro{
+  std::vector<int> keys;
+  bool recording = false;
+  size_t runs = 0;   // replays left, SIZE_MAX until a search fails
+  size_t next = 0;   // key of the current replay
+  size_t played = 0; // keys replayed so far
+  size_t done = 0;   // whole replays
+  size_t fileCount = 0; // files with an undo transaction open for the replay
+} macro;
+
+bool replaying(){
+  return macro.runs > 0;
+}
+
+// --record and --replay, see session.hpp
+Session session;
+std::string replayScreen; // the last frame of a replay, printed at exit
+int shownProgress = -1;   // percent of the job the last frame showed
+
+// the screen as text, once, the first time the replay ends
+void captureScreen(){
+  if(!replayScreen.empty()) return;
+  for(int y = 0; y < LINES; y++){
+    std::string row(COLS, ' ');
+    row.resize(std::max(mvinnstr(y, 0, row.data(), COLS), 0));
+    row.resize(row.find_last_not_of(' ') + 1);
+    replayScreen += row + '\n';
+  }
+}
+
+// getch, or the key that getch returned at this point of a replayed session.
+// A replay that ran out hands out esc until everything's closed
+int terminalKey(){
+  if(session.replay){
+    // getch would have drawn the frame
+    refresh();
+    SessionKey k;
+    if(!session.replayKey(k)){
+      if(!ctx.quit) captureScreen();
+      ctx.quit = true;
+      return 27;
+    }
+    if(k.rows != LINES || k.cols != COLS) resize_term(k.rows, k.cols);
+    return k.key;
+  }
+  int ch = getch();
+  if(session.record) session.recordKey(ch, LINES, COLS, shownProgress);
+  return ch;
+}
+
+// every key the editor reads comes from here
+int readKey(){
+  if(!replaying()){
+    int ch = terminalKey();
+    if(macro.recording && ch != ERR && ch != KEY_RESIZE) macro.keys.push_back(ch);
+    return ch;
+  }
+  if(++macro.played % MACRO_POLL == 0){
+    move(LINES-1, 0);
+    clrtoeol();
+    printw("macro ran %zu times (esc: stop)", macro.done);
+    timeout(0);
+    int ch = terminalKey();
+    if(ch == 27) macro.runs = 0;
+    else if(ch != ERR) ungetch(ch); // typed ahead, for after the replay
+    timeout(-1);
+  }
+  int ch = macro.keys[macro.next++];
+  if(macro.next == macro.keys.size()){
+    macro.next = 0;
+    macro.done++;
+    if(macro.runs != SIZE_MAX && macro.runs > 0) macro.runs--;
+  }
+  return ch;
+}
+
 void moveCursor(size_t d){
   size_t& cursor = panelTree[ctx.focus].file.cursor;
   cursor += d;
-  if(cursor >= files[panelTree[ctx.focus].file.i].data.size()-1) cursor -= d; // integer overflow good
+  if(cursor >= files[panelTree[ctx.focus].file.i].data.size()) cursor -= d; // integer overflow good
+}
+
+// grows or shrinks the selection by d bytes, the cursor byte always stays in it
+void growSelection(long d){
+  FileView& fv = panelTree[ctx.focus].file;
+  size_t size = files[fv.i].data.size();
+  long most = size > fv.cursor ? size - fv.cursor : 1;
+  fv.extent = std::clamp<long>((long)fv.extent + d, 1, most);
 }
 
 size_t findParent(size_t i){
@@ -220,38 +442,216 @@ int ceilDiv(int x, int y){
   return (x + y - 1) / y;
 }
 
-void printHex(char* data, size_t size, size_t selected, int selectedColor){
+// width panel target gets when the tree under i is drawn w wide, 0 if it
+// isn't under i
+uint32_t panelWidth(size_t target, size_t i = 0, uint32_t w = COLS){
+  if(i == target) return w;
+  if(!panelTree[i].isSplit) return 0;
+  size_t second = i+1 + getSpan(i+1);
+  bool across = panelTree[i].type == 0;
+  if(target < second) return panelWidth(target, i+1, across ? w/2 : w);
+  return panelWidth(target, second, across ? ceilDiv(w, 2) : w);
+}
+
+// [selFrom, selTo) is selected, colors, if given, holds a color pair per byte, 0 for none
+void printHex(const char* data, size_t size, size_t selFrom, size_t selTo, int selectedColor, const int* colors = nullptr){
   for(size_t i = 0; i < size; i++){
-    bool s = i == selected;
-    if(s) attron(COLOR_PAIR(selectedColor));
-    else if(data[i] == 0) attron(COLOR_PAIR(COLORPAIR_GRAY));
-    printw("%02x ", (uint8_t)(data[i]));
-    if(s) attroff(COLOR_PAIR(selectedColor));
-    else if(data[i] == 0) attroff(COLOR_PAIR(COLORPAIR_GRAY));
+    bool s = i >= selFrom && i < selTo;
+    int color = s ? selectedColor : colors && colors[i] ? colors[i] : data[i] == 0 ? COLORPAIR_GRAY : 0;
+    if(color) attron(COLOR_PAIR(color));
+    printw("%02x", (uint8_t)(data[i]));
+    if(color) attroff(COLOR_PAIR(color));
+    printw(" ");
   }
 }
 
-void printChar(char* data, size_t size, size_t selected, int selectedColor){
+void printChar(const char* data, size_t size, size_t selFrom, size_t selTo, int selectedColor, const int* colors = nullptr){
   for(size_t i = 0; i < size; i++){
-    bool s = i == selected;
+    bool s = i >= selFrom && i < selTo;
     uint8_t c = *(char*)&data[i];
-    if(s) attron(COLOR_PAIR(selectedColor));
-    if(c < 32 || c > 126){
-      if(!s) attron(COLOR_PAIR(COLORPAIR_GRAY));
-      printw(".");
-      if(!s) attroff(COLOR_PAIR(COLORPAIR_GRAY));
+    bool printable = c >= 32 && c <= 126;
+    int color = s ? selectedColor : colors && colors[i] ? colors[i] : !printable ? COLORPAIR_GRAY : 0;
+    if(color) attron(COLOR_PAIR(color));
+    printw("%c", printable ? c : '.');
+    if(color) attroff(COLOR_PAIR(color));
+  }
+}
+
+// row of bytes as values of type, one cell for every whole value that fits in columns
+void printTyped(const ViewType& type, bool bigEndian, const char* data, size_t size, size_t columns, size_t selFrom, size_t selTo, int selectedColor, const int* colors = nullptr){
+  static char cells[UINT16_MAX+1][TYPED_CELL];
+  static uint8_t lengths[UINT16_MAX+1];
+  size_t count = columns / type.size;
+  size_t full = size / type.size;
+  type.format((const uint8_t*)data, full, bigEndian, cells, lengths);
+  for(size_t c = 0; c < count; c++){
+    if(c >= full){
+      printw("%*s", type.width+1, "");
+      continue;
     }
-    else{
-      printw("%c", c);
+    int color = 0;
+    if(selFrom < (c+1)*type.size && selTo > c*type.size) color = selectedColor;
+    for(size_t b = c*type.size; !color && colors && b < (c+1)*type.size; b++) color = colors[b];
+    if(color) attron(COLOR_PAIR(color));
+    printw("%*.*s", type.width, lengths[c], cells[c]);
+    if(color) attroff(COLOR_PAIR(color));
+    printw(" ");
+  }
+}
+
+// What a row of a file view was drawn from. The screen isn't cleared between
+// frames, a row is only drawn again if something it depends on changed
+struct RowKey{
+  size_t file;
+  uint64_t version;
+  size_t ptr;
+  uint32_t w;
+  uint16_t columns = 0;
+  uint8_t type = 0;
+  bool bigEndian = false;
+  uint16_t selFrom = 0, selTo = 0;
+  int sel = 0;
+  uint64_t generation = 0; // everything else, see Context::paintGeneration
+
+  bool operator==(const RowKey& o) const{
+    return file == o.file && version == o.version && ptr == o.ptr && w == o.w && columns == o.columns && type == o.type
+      && bigEndian == o.bigEndian && selFrom == o.selFrom && selTo == o.selTo && sel == o.sel && generation == o.generation;
+  }
+};
+std::unordered_map<uint64_t, RowKey> drawnRows; // by screen position
+
+// true if the row at x, y was drawn from key last time, remembers key otherwise
+bool rowDrawn(uint32_t x, uint32_t y, const RowKey& key){
+  RowKey& drawn = drawnRows[(uint64_t)x << 32 | y];
+  if(drawn == key) return true;
+  drawn = key;
+  return false;
+}
+
+void forgetRow(uint32_t x, uint32_t y){
+  drawnRows.erase((uint64_t)x << 32 | y);
+}
+
+// for anything drawing over the panels, the next frame draws every row again
+void clearScreen(){
+  clear();
+  drawnRows.clear();
+}
+
+// one row of bytes from ptr on, the cursor is already where it goes
+void rowDraw(FileView& fv, size_t ptr, uint16_t remainder, size_t selFrom, size_t selTo, int sel, uint32_t w, size_t columns){
+  File& file = files[fv.i];
+  const ViewType& type = viewTypes[fv.type];
+  static std::string scratch;
+  const char* data = file.data.view(ptr, remainder, scratch);
+  if(fv.xorLength > 0){
+    static std::string previewed;
+    previewed.assign(data, remainder);
+    size_t length = fv.xorLength;
+    // the key starts at xorOrigin, the bytes before it are left alone
+    size_t b = fv.xorOrigin > ptr ? std::min<size_t>(fv.xorOrigin - ptr, remainder) : 0;
+    size_t phase = (ptr + b - fv.xorOrigin) % length;
+    for(; b < remainder; b++){
+      previewed[b] ^= fv.xorKey[phase];
+      if(++phase == length) phase = 0;
+    }
+    data = previewed.data();
+  }
+
+
+  static int colors[UINT16_MAX+1];
+  const int* rowColors = nullptr;
+  auto paint = [&](size_t begin, size_t end, int color){
+    if(!rowColors) memset(colors, 0, remainder*sizeof(int));
+    rowColors = colors;
+    for(size_t b = std::max(begin, ptr); b < std::min(end, ptr+remainder); b++){
+      colors[b-ptr] = color;
+    }
+  };
+
+  // bytes the other file of a diff doesn't have, an empty side gets one
+  // byte so it can be seen where something went missing
+  if((fv.i == diff.a || fv.i == diff.b) && diff.active()){
+    auto& ranges = diff.result.ranges;
+    auto r = std::lower_bound(ranges.begin(), ranges.end(), ptr, [&](const DiffRange& r, size_t o){
+      uint64_t offset, size;
+      diff.side(r, fv.i, offset, size);
+      return offset + std::max<uint64_t>(size, 1) <= o;
+    });
+    for(; r != ranges.end(); r++){
+      uint64_t offset, size;
+      diff.side(*r, fv.i, offset, size);
+      if(offset >= ptr+remainder) break;
+      paint(offset, offset + std::max<uint64_t>(size, 1), COLORPAIR_DIFF);
+    }
+  }
+
+  // template fields, neighbours alternate so they can be told apart
+  if(file.layout){
+    Layout& layout = *file.layout;
+    layout.leaves(0, ptr, ptr+remainder, [&](uint64_t offset, uint64_t size, int parity){
+      paint(offset, offset+size, parity ? COLORPAIR_FIELD2 : COLORPAIR_FIELD);
+    });
+    if(layout.selected >= 0){
+      uint64_t size = layout.sizeOf(layout.selected);
+      uint64_t offset = layout.nodes[layout.selected].offset;
+      if(size != LAYOUT_UNKNOWN && offset < ptr+remainder && offset+size > ptr) paint(offset, offset+size, COLORPAIR_MARK);
     }
-    if(s) attroff(COLOR_PAIR(selectedColor));
   }
+
+  // annotations touching this row
+  const char* label = nullptr;
+  auto& notes = file.annotations;
+  size_t from = ptr > file.annotationMaxSize ? ptr - file.annotationMaxSize : 0;
+  auto it = std::lower_bound(notes.begin(), notes.end(), from, [](const Annotation& a, size_t o){ return a.offset < o; });
+  for(; it != notes.end() && it->offset < ptr+remainder; it++){
+    if(it->offset + it->size <= ptr) continue;
+    paint(it->offset, it->offset+it->size, COLORPAIR_MARK);
+    if(it->offset >= ptr && !label) label = it->label;
+  }
+  auto& hits = file.search.hits;
+  size_t patternSize = file.search.pattern.size();
+  for(auto hit = hits.lowerBound(ptr >= patternSize ? ptr-patternSize+1 : 0); !hits.atEnd(hit) && hits[hit] < ptr+remainder; hits.next(hit)){
+    paint(hits[hit], hits[hit]+patternSize, COLORPAIR_HIT);
+  }
+
+  if(fv.type == 0){
+    printHex(data, remainder, selFrom, selTo, sel, rowColors);
+    printw("%*s", (fv.columns-remainder+1)*3-1, "| ");
+  }
+  else{
+    printTyped(type, fv.bigEndian, data, remainder, fv.columns, selFrom, selTo, sel, rowColors);
+    printw("| ");
+  }
+  printChar(data, remainder, selFrom, selTo, sel, rowColors);
+  if(label && w > columns + 1){
+    printw(" %.*s", (int)(w-columns-2), label);
+  }
+}
+
+// characters a row of fv takes with that many columns
+size_t rowWidth(const FileView& fv, size_t columns){
+  const ViewType& type = viewTypes[fv.type];
+  return fv.type == 0 ? columns*4+3 : columns/type.size*(type.width+1) + 2 + columns;
 }
 
-void fileDraw(FileView& fv, uint32_t x, uint32_t y, uint32_t w, uint32_t h){
+// framed views are drawn over the top and sides of their panel's frame
+void fileDraw(FileView& fv, uint32_t x, uint32_t y, uint32_t w, uint32_t h, bool framed = false){
   File& file = files[fv.i];
-  size_t columns = fv.columns*4+3;
+  size_t columns = rowWidth(fv, fv.columns);
+  // what's under a row, the cursor is left at its start
+  auto background = [&](size_t line){
+    move(y+line, x);
+    if(!framed) printw("%*s", (int)w, "");
+    else if(line == 0) printw("/%s\\", std::string(w-2, '`').data());
+    else printw("|%*s|", (int)w-2, "");
+    move(y+line, x);
+  };
   if(w < columns){
+    for(size_t line = 0; line < h; line++){
+      forgetRow(x, y+line);
+      background(line);
+    }
     const char msg[] = "Width is too small";
     if(w < strlen(msg)+1){
       for(size_t i = 0; i < strlen(msg); i++){
@@ -265,22 +665,32 @@ void fileDraw(FileView& fv, uint32_t x, uint32_t y, uint32_t w, uint32_t h){
     }
     return;
   }
-  for(size_t line = 0; line < h; line++){
+  if(file.layout) file.layout->use(file.data.source(), file.data.version);
+  size_t line = 0;
+  for(; line < h; line++){
     size_t l = line+fv.scroll;
-    size_t ptr = l*panelTree[ctx.focus].file.columns;
-    move(y+line, x);
-    char* data = file.data.data()+ptr;
-    size_t localSelected = fv.cursor-ptr;
-    uint16_t remainder = std::min(file.data.size()-ptr-1, (size_t)fv.columns);
-    if(remainder == 0) break;
-
+    size_t ptr = l*fv.columns;
+    if(ptr >= file.data.size()) break;
+    size_t selFrom = fv.cursor > ptr ? fv.cursor-ptr : 0;
+    size_t selTo = fv.cursor+fv.extent > ptr ? fv.cursor+fv.extent-ptr : 0;
+    uint16_t remainder = std::min(file.data.size()-ptr, (size_t)fv.columns);
     int sel = (&fv == &panelTree[ctx.focus].file)?COLORPAIR_INV:COLORPAIR_SEL;
-    
-    printHex(data, remainder, localSelected, sel);
-    printw("%*s", (fv.columns-remainder+1)*3-1, "| ");
-    printChar(data, remainder, localSelected, sel);
 
-    if(remainder < fv.columns) break;
+    // a row drawn from the same things last frame is still right on screen
+    RowKey key{fv.i, file.data.version, ptr, w, fv.columns, fv.type, fv.bigEndian,
+      (uint16_t)std::min<size_t>(selFrom, remainder), (uint16_t)std::min<size_t>(selTo, remainder), sel, ctx.paintGeneration};
+    if(!rowDrawn(x, y+line, key)){
+      background(line);
+      rowDraw(fv, ptr, remainder, selFrom, selTo, sel, w, columns);
+    }
+    if(remainder < fv.columns){
+      line++;
+      break;
+    }
+  }
+  // past the end of the file
+  for(; line < h; line++){
+    if(!rowDrawn(x, y+line, RowKey{SIZE_MAX, 0, 0, w})) background(line);
   }
 }
 
@@ -313,22 +723,28 @@ size_t panelTreeDraw(size_t i, uint32_t x, uint32_t y, uint32_t w, uint32_t h, u
     while(scrollPadding > (h-1)/2){
       scrollPadding--;
     }
-    while(cursor/fv.columns > fv.scroll + h - 2 - scrollPadding){
-      fv.scroll ++;
+    size_t cursorLine = cursor/fv.columns;
+    if(cursorLine > fv.scroll + h - 2 - scrollPadding){
+      fv.scroll = cursorLine - (h - 2 - scrollPadding);
     }
-    while(cursor/fv.columns < fv.scroll + scrollPadding && fv.scroll != 0){
-      fv.scroll --;
+    if(cursorLine < fv.scroll + scrollPadding){
+      fv.scroll = cursorLine > scrollPadding ? cursorLine - scrollPadding : 0;
     }
 
 
     if(drawSplit && i == ctx.focus) attron(COLOR_PAIR(COLORPAIR_INV));
-    drawBox(x, y, w, h);
+    if(drawSplit) drawBox(x, y, w, h);
+    else{
+      // the rest of the frame is under the rows, fileDraw draws it with them
+      move(y+h-1, x);
+      printw("\\%s/", std::string(w-2, '_').data());
+    }
     std::string name = files[pt.file.i].name();
     move(y+h-1, x+w-name.size()-3);
     printw(" %s ", name.data());
     if(drawSplit && i == ctx.focus) attroff(COLOR_PAIR(COLORPAIR_INV));
 
-    fileDraw(pt.file, x+drawSplit, y+drawSplit, w-drawSplit*2, h-1-drawSplit*2);
+    fileDraw(pt.file, x+drawSplit, y+drawSplit, w-drawSplit*2, h-1-drawSplit*2, !drawSplit);
 
     // move(y+h-1, x);
     // printw("0x%x", fv.cursor);
@@ -336,20 +752,1273 @@ size_t panelTreeDraw(size_t i, uint32_t x, uint32_t y, uint32_t w, uint32_t h, u
   return 1;  
 }
 
+const int INSPECTOR_CELL = 60;
+
+int inspectorHeight(){
+  int perRow = std::max(COLS / INSPECTOR_CELL, 1);
+  return 1 + ceilDiv(inspectorTypeCount, perRow);
+}
+
+// values at the focused cursor as little / big endian, in cells across the screen
+void inspectorDraw(uint32_t y){
+  static Inspector inspector;
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  inspector.update(file.data.source(), &file.data, file.data.version, fv.cursor);
+
+  for(int line = 0; line < inspectorHeight(); line++){
+    move(y+line, 0);
+    clrtoeol();
+  }
+  move(y, 0);
+  attron(COLOR_PAIR(COLORPAIR_INV));
+  printw(" 0x%08zx  little / big endian ", fv.cursor);
+  attroff(COLOR_PAIR(COLORPAIR_INV));
+  int perRow = std::max(COLS / INSPECTOR_CELL, 1);
+  for(size_t t = 0; t < inspectorTypeCount; t++){
+    move(y + 1 + t/perRow, (t%perRow) * INSPECTOR_CELL);
+    attron(COLOR_PAIR(COLORPAIR_GRAY));
+    printw("%-8s", inspectorTypes[t].name);
+    attroff(COLOR_PAIR(COLORPAIR_GRAY));
+    printw("%-25.24s %.24s", inspector.little[t], inspector.big[t]);
+  }
+}
+
+// Single line input on the bottom row, returns false if cancelled with esc.
+// With a history up/down go through earlier lines, tab hands the line and
+// cursor to complete
+bool promptInput(const char* prefix, std::string& out, History* history = nullptr, std::function<void(std::string&, size_t&)> complete = nullptr){
+  out.clear();
+  size_t cursor = 0;
+  size_t recalled = history ? history->lines.size() : 0;
+  std::string draft; // what was typed before going up
+  curs_set(1);
+  while(true){
+    if(!replaying()){
+      move(LINES-1, 0);
+      clrtoeol();
+      printw("%s%s", prefix, out.data());
+      move(LINES-1, strlen(prefix)+cursor);
+    }
+    int ch = readKey();
+    switch(ch){
+      case '\n': {
+        curs_set(0);
+        if(history) history->add(out);
+        return true;
+      };
+      case 27: { // esc
+        curs_set(0);
+        return false;
+      };
+      case KEY_UP:
+      case KEY_DOWN: {
+        if(!history) break;
+        if(ch == KEY_UP && recalled == 0) break;
+        if(ch == KEY_DOWN && recalled == history->lines.size()) break;
+        if(recalled == history->lines.size()) draft = out;
+        recalled += ch == KEY_UP ? -1 : 1;
+        out = recalled == history->lines.size() ? draft : history->lines[recalled];
+        cursor = out.size();
+      }; break;
+      case '\t': if(complete) complete(out, cursor); break;
+      case KEY_LEFT:  if(cursor > 0) cursor--; break;
+      case KEY_RIGHT: if(cursor < out.size()) cursor++; break;
+      case KEY_BACKSPACE:
+      case 127: {
+        if(cursor > 0){
+          out.erase(cursor-1, 1);
+          cursor--;
+        }
+      }; break;
+      case KEY_DC: {
+        if(cursor < out.size()) out.erase(cursor, 1);
+      }; break;
+      default: {
+        if(ch >= 32 && ch < 127){
+          out.insert(cursor, 1, ch);
+          cursor++;
+        }
+      }; break;
+    }
+  }
+}
+
+// List of count rows under the panels. Only the rows on screen are formatted,
+// so it doesn't matter how long the list is. onMove gets the highlighted row
+// every time it changes, returns false if the list was left with esc/q.
+// Keys the list doesn't use go to onKey with the highlighted row
+bool resultList(const char* title, size_t count, std::function<void(size_t)> printRow, std::function<void(size_t)> onMove, std::function<void(int, size_t)> onKey = nullptr){
+  size_t selected = 0;
+  size_t top = 0;
+  onMove(selected);
+  while(true){
+    size_t rows = std::min<size_t>(count, LINES/3);
+    if(selected < top) top = selected;
+    if(selected >= top + rows) top = selected - rows + 1;
+
+    if(!replaying()){
+      clearScreen();
+      panelTreeDraw(0, 0, 0, COLS, LINES-rows-2);
+      move(LINES-rows-2, 0);
+      attron(COLOR_PAIR(COLORPAIR_INV));
+      printw(" %s %zu/%zu ", title, selected+1, count);
+      attroff(COLOR_PAIR(COLORPAIR_INV));
+      for(size_t r = 0; r < rows && top+r < count; r++){
+        move(LINES-rows-1+r, 0);
+        if(top+r == selected) attron(COLOR_PAIR(COLORPAIR_SEL));
+        printRow(top+r);
+        if(top+r == selected) attroff(COLOR_PAIR(COLORPAIR_SEL));
+      }
+      refresh();
+    }
+
+    size_t before = selected;
+    int ch = readKey();
+    switch(ch){
+      case 'q':
+      case 27: return false;
+      case '\n': return true;
+      case KEY_DOWN:  if(selected+1 < count) selected++; break;
+      case KEY_UP:    if(selected > 0) selected--; break;
+      case KEY_NPAGE: selected = std::min(selected+rows, count-1); break;
+      case KEY_PPAGE: selected = selected > rows ? selected-rows : 0; break;
+      case KEY_HOME:  selected = 0; break;
+      case KEY_END:   selected = count-1; break;
+      default: if(onKey) onKey(ch, selected); break;
+    }
+    if(selected != before) onMove(selected);
+  }
+}
+
+// Work done on a thread of its own while the editor keeps drawing. One runs
+// at a time and edits wait for it, so it can read the files without locks.
+// finish runs on the main thread afterwards, unless it was cancelled
+struct Job{
+  std::string name;
+  uint64_t total = 0; // units of done at the end, 0 if there's no telling
+  std::atomic<uint64_t> done = 0;
+  std::atomic<bool> cancel = false;
+  std::atomic<bool> finished = false;
+  std::function<void()> finish;
+  std::thread thread;
+};
+std::unique_ptr<Job> job;
+
+bool startJob(const std::string& name, uint64_t total, std::function<void(Job&)> work, std::function<void()> finish){
+  if(job){
+    ctx.status = "Busy with " + job->name;
+    return false;
+  }
+  if(replaying()){
+    // the next keys of the macro expect it done
+    Job j;
+    work(j);
+    finish();
+    return true;
+  }
+  job = std::make_unique<Job>();
+  job->name = name;
+  job->total = total;
+  job->finish = finish;
+  Job* j = job.get();
+  job->thread = std::thread([j, work](){
+    work(*j);
+    j->finished = true;
+  });
+  return true;
+}
+
+void jobDone(){
+  if(session.record) session.recordJobDone();
+  job->thread.join();
+  std::unique_ptr<Job> j = std::move(job);
+  if(j->cancel) ctx.status = j->name + " cancelled";
+  else j->finish();
+}
+
+// edits would change the bytes under the job
+bool editable(){
+  if(!job) return true;
+  ctx.status = "Busy with " + job->name + ", esc cancels";
+  return false;
+}
+
+// pattern as parsePattern takes it, the hits are listed once every file was
+// searched
+void startSearch(std::string_view input){
+  std::string pattern;
+  if(!parsePattern(input, pattern)){
+    ctx.status = "Invalid pattern, expected hex bytes or \"text\"";
+    return;
+  }
+  std::vector<ByteSource> buffers;
+  uint64_t total = 0;
+  for(File& f: files){
+    buffers.push_back(f.data.source());
+    total += buffers.back().size;
+  }
+  auto hits = std::make_shared<std::vector<SearchHit>>();
+  startJob("search", total, [=](Job& j){
+    *hits = searchBuffers(buffers, pattern, j.done, j.cancel);
+  }, [=](){
+    // every file remembers it, later edits only search around themselves
+    for(File& f: files){
+      f.search.pattern = pattern;
+      f.search.hits.clear();
+    }
+    for(SearchHit& hit: *hits) files[hit.file].search.hits.push_back(hit.offset);
+    if(hits->size() == 0){
+      ctx.status = "No matches";
+      return;
+    }
+
+    FileView& fv = panelTree[ctx.focus].file;
+    FileView before = fv;
+    bool chosen = resultList("matches", hits->size(), [&](size_t r){
+      SearchHit& hit = (*hits)[r];
+      printw("%3zu %-24s 0x%08zx", hit.file, files[hit.file].name().data(), hit.offset);
+    }, [&](size_t r){
+      fv.i = (*hits)[r].file;
+      fv.cursor = (*hits)[r].offset;
+    });
+    if(!chosen) fv = before;
+    clearScreen();
+  });
+}
+
+void globalSearch(){
+  std::string input;
+  if(!promptInput("search: ", input)) return;
+  startSearch(input);
+}
+
+void regexSearch(){
+  std::string input;
+  if(!promptInput("regex: ", input)) return;
+  Regex re;
+  if(!re.compile(input)){
+    ctx.status = re.error;
+    return;
+  }
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  std::vector<std::pair<size_t, size_t>> hits;
+  re.scan([&](size_t offset){ return file.data.span(offset); }, 0, file.data.size(), [&](size_t begin, size_t end){
+    hits.push_back({begin, end});
+  });
+  if(hits.size() == 0){
+    ctx.status = "No matches";
+    return;
+  }
+
+  FileView before = fv;
+  bool chosen = resultList("regex matches", hits.size(), [&](size_t r){
+    size_t begin = hits[r].first;
+    size_t size = hits[r].second - begin;
+    printw("0x%08zx %6zu  ", begin, size);
+    std::string scratch;
+    size_t shown = std::min<size_t>(size, 32);
+    printChar(file.data.view(begin, shown, scratch), shown, 0, 0, 0);
+  }, [&](size_t r){
+    fv.cursor = hits[r].first;
+  });
+  if(!chosen) fv = before;
+  clearScreen();
+}
+
+void stringsSearch(){
+  std::string input;
+  if(!promptInput("strings min length (4): ", input)) return;
+  size_t minLength = 4;
+  if(input.size() > 0){
+    try{
+      minLength = std::stoul(input);
+    }
+    catch(std::exception& e){
+      ctx.status = "Invalid length";
+      return;
+    }
+  }
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  std::vector<StringHit> hits = extractStrings(file.data.source(), minLength);
+  if(hits.size() == 0){
+    ctx.status = "No strings";
+    return;
+  }
+
+  FileView before = fv;
+  bool chosen = resultList("strings", hits.size(), [&](size_t r){
+    StringHit& hit = hits[r];
+    printw("0x%08llx %c %6u  ", (unsigned long long)hit.offset, hit.wide ? 'w' : 'a', hit.length);
+    size_t room = std::min<size_t>(hit.length, std::max(COLS-22, 0));
+    std::string scratch;
+    const char* text = file.data.view(hit.offset, room*(hit.wide ? 2 : 1), scratch);
+    for(size_t c = 0; c < room; c++){
+      char ch = text[hit.wide ? c*2 : c];
+      addch(ch == '\t' ? ' ' : ch);
+    }
+  }, [&](size_t r){
+    fv.cursor = hits[r].offset;
+  });
+  if(!chosen) fv = before;
+  clearScreen();
+}
+
+bool exportCarve(std::vector<CarveHit>& hits, std::string path){
+  std::ofstream out(path);
+  if(!out) return false;
+  out << "offset,type,size,valid\n";
+  char line[96];
+  for(CarveHit& hit: hits){
+    snprintf(line, sizeof(line), "0x%llx,%s,%llu,%d\n", (unsigned long long)hit.offset, signatures[hit.signature].name, (unsigned long long)hit.size, hit.valid);
+    out << line;
+  }
+  return (bool)out;
+}
+
+void carveScan(){
+  std::string input;
+  if(!promptInput("validate headers? (Y/n): ", input)) return;
+  bool validate = input != "n" && input != "N";
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  std::vector<CarveHit> hits = carve(file.data.source(), validate);
+
+  file.annotations.clear();
+  file.annotationMaxSize = 0;
+  for(CarveHit& hit: hits){
+    const Signature& sig = signatures[hit.signature];
+    file.annotations.push_back({hit.offset + sig.magicOffset, sig.magic.size(), sig.name});
+    file.annotationMaxSize = std::max(file.annotationMaxSize, sig.magic.size());
+  }
+  std::stable_sort(file.annotations.begin(), file.annotations.end(), [](const Annotation& a, const Annotation& b){
+    return a.offset < b.offset;
+  });
+  if(hits.size() == 0){
+    ctx.status = "No embedded files found";
+    return;
+  }
+
+  FileView before = fv;
+  bool chosen = resultList("embedded files (x: export)", hits.size(), [&](size_t r){
+    CarveHit& hit = hits[r];
+    printw("0x%08llx %-9s %s", (unsigned long long)hit.offset, signatures[hit.signature].name, hit.valid ? "     " : " ??? ");
+    if(hit.size) printw("%llu bytes", (unsigned long long)hit.size);
+  }, [&](size_t r){
+    fv.cursor = hits[r].offset;
+  }, [&](int ch, size_t r){
+    if(ch != 'x') return;
+    std::string path;
+    if(!promptInput("export to: ", path) || path.empty()) return;
+    ctx.status = exportCarve(hits, path) ? "Exported to " + path : "Can't write " + path;
+  });
+  if(!chosen) fv = before;
+  clearScreen();
+}
+
+bool loadTemplate(File& file){
+  std::string path;
+  if(!promptInput("template: ", path) || path.empty()) return false;
+  std::ifstream in(path);
+  if(!in){
+    ctx.status = "Can't read " + path;
+    return false;
+  }
+  auto layout = std::make_unique<Layout>();
+  if(!layout->compile(readFile(path))){
+    ctx.status = layout->error;
+    return false;
+  }
+  file.layout = std::move(layout);
+  return true;
+}
+
+// tree of the focused file's template next to the panels, the cursor follows
+// the highlighted node
+void templateBrowse(){
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  Layout& layout = *file.layout;
+  uint64_t selected = 0;
+  uint64_t top = 0;
+  char line[512];
+  while(true){
+    layout.use(file.data.source(), file.data.version);
+    int width = std::max(COLS/3, 30);
+    uint64_t rows = LINES-2;
+    uint64_t total = layout.rows(0);
+    selected = std::min(selected, total-1);
+    if(selected < top) top = selected;
+    if(selected >= top + rows) top = selected - rows + 1;
+    int node = layout.rowNode(0, selected);
+    layout.selected = node;
+    if(file.data.size() > 0) fv.cursor = std::min<uint64_t>(layout.nodes[node].offset, file.data.size()-1);
+
+    clearScreen();
+    panelTreeDraw(0, 0, 0, COLS-width, LINES-1);
+    move(0, COLS-width);
+    attron(COLOR_PAIR(COLORPAIR_INV));
+    printw(" %-*.*s", width-1, width-1, layout.structs[0].name.data());
+    attroff(COLOR_PAIR(COLORPAIR_INV));
+    for(uint64_t r = 0; r < rows && top+r < total; r++){
+      layout.describe(layout.rowNode(0, top+r), line, sizeof(line));
+      move(1+r, COLS-width);
+      if(top+r == selected) attron(COLOR_PAIR(COLORPAIR_SEL));
+      printw("%-*.*s", width, width, line);
+      if(top+r == selected) attroff(COLOR_PAIR(COLORPAIR_SEL));
+    }
+    move(LINES-1, 0);
+    printw("enter/right: expand  left: collapse  q: close");
+    refresh();
+
+    int ch = readKey();
+    switch(ch){
+      case 'q':
+      case 27: {
+        layout.selected = -1;
+        clearScreen();
+        return;
+      };
+      case KEY_DOWN:  if(selected+1 < total) selected++; break;
+      case KEY_UP:    if(selected > 0) selected--; break;
+      case KEY_NPAGE: selected = std::min(selected+rows, total-1); break;
+      case KEY_PPAGE: selected = selected > rows ? selected-rows : 0; break;
+      case KEY_HOME:  selected = 0; break;
+      case KEY_END:   selected = total-1; break;
+      case '\n':
+      // drawing the panels may have compacted the nodes, selected is kept up to date
+      case KEY_RIGHT: layout.expand(layout.selected, true); break;
+      case KEY_LEFT:  layout.expand(layout.selected, false); break;
+    }
+  }
+}
+
+// moves the cursor to the next/previous hit of the focused file's search
+bool jumpToHit(bool forward){
+  FileView& fv = panelTree[ctx.focus].file;
+  ActiveSearch& search = files[fv.i].search;
+  if(search.pattern.empty()){
+    ctx.status = "No active search";
+    macro.runs = 0;
+    return false;
+  }
+  auto& hits = search.hits;
+  auto it = hits.lowerBound(forward ? fv.cursor+1 : fv.cursor);
+  size_t rank = hits.rank(it);
+  if(forward ? hits.atEnd(it) : rank == 0){
+    ctx.status = "No more matches";
+    macro.runs = 0;
+    return false;
+  }
+  if(!forward){
+    hits.previous(it);
+    rank--;
+  }
+  fv.cursor = hits[it];
+  ctx.status = "Match " + std::to_string(rank+1) + "/" + std::to_string(hits.size());
+  return true;
+}
+
+// puts every view of either file at its side of range r
+void showDiffRange(size_t r){
+  const DiffRange& range = diff.result.ranges[r];
+  for(Panel& p: panelTree){
+    if(p.isSplit || (p.file.i != diff.a && p.file.i != diff.b)) continue;
+    uint64_t offset, size;
+    diff.side(range, p.file.i, offset, size);
+    p.file.cursor = std::min<size_t>(offset, files[p.file.i].data.size());
+    p.file.extent = 1;
+  }
+  ctx.status = "Difference " + std::to_string(r+1) + "/" + std::to_string(diff.result.ranges.size());
+  if(diff.result.truncated) ctx.status += "+";
+}
+
+void diffList(){
+  std::vector<Panel> before = panelTree;
+  std::string title = files[diff.a].name() + " / " + files[diff.b].name() + (diff.result.truncated ? " (first differences only)" : "");
+  bool chosen = resultList(title.data(), diff.result.ranges.size(), [&](size_t r){
+    const DiffRange& range = diff.result.ranges[r];
+    printw("0x%08llx %8llu bytes  ->  0x%08llx %8llu bytes", (unsigned long long)range.a, (unsigned long long)range.aSize, (unsigned long long)range.b, (unsigned long long)range.bSize);
+  }, showDiffRange);
+  if(!chosen) panelTree = before;
+  clearScreen();
+}
+
+// compares the focused file with another one, picked from a list if there
+// are more than two open
+void diffStart(){
+  if(files.size() < 2){
+    ctx.status = "Diff needs two open files";
+    return;
+  }
+  size_t a = panelTree[ctx.focus].file.i;
+  std::vector<size_t> others;
+  for(size_t f = 0; f < files.size(); f++) if(f != a) others.push_back(f);
+  size_t picked = 0;
+  if(others.size() > 1){
+    bool chosen = resultList("diff against", others.size(), [&](size_t r){
+      printw("%3zu %s", others[r], files[others[r]].name().data());
+    }, [&](size_t r){
+      picked = r;
+    });
+    if(!chosen) return;
+  }
+  diff.a = a;
+  diff.b = others[picked];
+  diff.versionA = files[diff.a].data.version;
+  diff.versionB = files[diff.b].data.version;
+  diff.result = diffBuffers(files[diff.a].data.source(), files[diff.b].data.source());
+  if(diff.result.ranges.empty()){
+    ctx.status = "Files are the same";
+    return;
+  }
+  diffList();
+}
+
+// next or previous difference after the cursor of the focused file
+void diffJump(bool forward){
+  FileView& fv = panelTree[ctx.focus].file;
+  if(!diff.active() || (fv.i != diff.a && fv.i != diff.b)){
+    ctx.status = "No diff for this file, D starts one";
+    return;
+  }
+  auto& ranges = diff.result.ranges;
+  auto offsetOf = [&](const DiffRange& r){
+    uint64_t offset, size;
+    diff.side(r, fv.i, offset, size);
+    return offset;
+  };
+  auto it = forward
+    ? std::upper_bound(ranges.begin(), ranges.end(), fv.cursor, [&](size_t o, const DiffRange& r){ return o < offsetOf(r); })
+    : std::lower_bound(ranges.begin(), ranges.end(), fv.cursor, [&](const DiffRange& r, size_t o){ return offsetOf(r) < o; });
+  if(forward ? it == ranges.end() : it == ranges.begin()){
+    ctx.status = "No more differences";
+    return;
+  }
+  if(!forward) it--;
+  showDiffRange(it - ranges.begin());
+}
+
+// Views linked with the focused one follow its cursor, selection and scroll.
+// Each stays as far from where it was linked as the focused one is from its
+// own anchor, so views of shifted data stay on corresponding bytes
+void followLinks(){
+  if(panelTree[ctx.focus].isSplit) return;
+  FileView& fv = panelTree[ctx.focus].file;
+  if(fv.link == 0) return;
+  for(size_t p = 0; p < panelTree.size(); p++){
+    if(p == ctx.focus || panelTree[p].isSplit || panelTree[p].file.link != fv.link) continue;
+    FileView& other = panelTree[p].file;
+    size_t size = files[other.i].data.size();
+    int64_t cursor = (int64_t)fv.cursor - (int64_t)fv.linkAnchor + (int64_t)other.linkAnchor;
+    other.cursor = std::clamp<int64_t>(cursor, 0, size > 0 ? size-1 : 0);
+    other.extent = std::max<size_t>(1, std::min(fv.extent, size - std::min(other.cursor, size)));
+    int64_t row = (int64_t)(fv.cursor/fv.columns) - (int64_t)fv.scroll;
+    other.scroll = std::max<int64_t>(0, (int64_t)(other.cursor/other.columns) - row);
+  }
+}
+
+void linkView(){
+  FileView& fv = panelTree[ctx.focus].file;
+  move(LINES-1, 0);
+  clrtoeol();
+  printw("link group (1-9, 0 unlinks): ");
+  int ch = readKey();
+  if(ch < '0' || ch > '9') return;
+  fv.link = ch - '0';
+  fv.linkAnchor = fv.cursor;
+  ctx.status = fv.link ? "Linked to group " + std::to_string(fv.link) : "Unlinked";
+}
+
+void startChecksums(size_t begin, size_t end){
+  auto result = std::make_shared<Checksums>();
+  ByteSource source = files[panelTree[ctx.focus].file.i].data.source();
+  startJob("checksums", 4*(end-begin), [=](Job& j){
+    checksumRange(source, begin, end, *result, j.done, j.cancel);
+  }, [=](){
+    char values[4][72];
+    snprintf(values[0], sizeof(values[0]), "%08x", result->crc32);
+    snprintf(values[1], sizeof(values[1]), "%08x", result->crc32c);
+    snprintf(values[2], sizeof(values[2]), "%016llx", (unsigned long long)result->xxh64);
+    for(int b = 0; b < 32; b++) snprintf(values[3]+b*2, 3, "%02x", result->sha256[b]);
+    const char* names[4] = {"crc32", "crc32c", "xxh64", "sha256"};
+    std::string title = "checksums of " + std::to_string(end - begin) + " bytes";
+    resultList(title.data(), 4, [&](size_t r){
+      printw("%-8s %s", names[r], values[r]);
+    }, [](size_t r){});
+    clearScreen();
+  });
+}
+
+void startChecksums(bool wholeFile){
+  FileView& fv = panelTree[ctx.focus].file;
+  size_t size = files[fv.i].data.size();
+  if(wholeFile) startChecksums(0, size);
+  else startChecksums(std::min(fv.cursor, size), std::min(fv.cursor+fv.extent, size));
+}
+
+// gram as hex bytes and as text
+void printGram(const Gram& g, int n){
+  for(int b = 0; b < n; b++) printw("%02x ", (unsigned)(g.key >> b*8 & 0xff));
+  for(int b = 0; b < n; b++){
+    uint8_t c = g.key >> b*8;
+    printw("%c", c >= 32 && c <= 126 ? c : '.');
+  }
+  printw(" %10llu", (unsigned long long)g.count);
+}
+
+// histogram, entropy and common n-grams of the selection, or the whole
+// file if only the cursor byte is selected
+void statsPanel(){
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  size_t size = file.data.size();
+  bool whole = fv.extent <= 1;
+  size_t begin = whole ? 0 : std::min(fv.cursor, size);
+  size_t end = whole ? size : std::min(fv.cursor+fv.extent, size);
+  ByteStats st = byteStats(file.data.source(), begin, end, file.stats);
+
+  const int bars = 8; // rows of the histogram
+  int height = bars + 4;
+  int top = LINES-1-height;
+  clearScreen();
+  panelTreeDraw(0, 0, 0, COLS, top);
+  move(top, 0);
+  attron(COLOR_PAIR(COLORPAIR_INV));
+  printw(" 0x%zx-0x%zx %zu bytes  entropy %.3f bits/byte  zeros %.1f%%  printable %.1f%% ", begin, end, end-begin, st.entropy, st.zeros*100, st.printable*100);
+  attroff(COLOR_PAIR(COLORPAIR_INV));
+
+  // 64 columns of 4 byte values each
+  uint64_t columns[64] = {};
+  uint64_t most = 1;
+  for(int v = 0; v < 256; v++) columns[v/4] += st.counts[v];
+  for(int c = 0; c < 64; c++) most = std::max(most, columns[c]);
+  for(int r = 0; r < bars; r++){
+    move(top+1+r, 0);
+    for(int c = 0; c < 64; c++){
+      // eighths of a row, rounded up so anything there shows
+      uint64_t level = (columns[c]*bars*8 + most-1) / most;
+      int64_t filled = (int64_t)level - (bars-1-r)*8;
+      printw("%c", filled >= 8 ? '#' : filled > 0 ? (filled >= 4 ? '+' : '.') : ' ');
+    }
+  }
+  move(top+1+bars, 0);
+  printw("00              40              80              c0             ff");
+
+  int x = 70;
+  move(top+1, x);
+  printw("top 2-grams");
+  move(top+1, x+30);
+  printw("top 4-grams (first %zu MiB)", STATS_NGRAM_LIMIT >> 20);
+  for(size_t g = 0; g < STATS_TOP; g++){
+    if(g < st.bigrams.size()){
+      move(top+2+g, x);
+      printGram(st.bigrams[g], 2);
+    }
+    if(g < st.quadgrams.size()){
+      move(top+2+g, x+30);
+      printGram(st.quadgrams[g], 4);
+    }
+  }
+  move(LINES-1, 0);
+  printw("any key to close");
+  refresh();
+  readKey();
+  clearScreen();
+}
+
+// likely record lengths of the focused file, the highlighted one is shown as
+// the row width right away and kept with enter
+void strideSuggest(){
+  FileView& fv = panelTree[ctx.focus].file;
+  std::vector<StrideGuess> guesses = detectStrides(files[fv.i].data.source());
+  if(guesses.empty()){
+    ctx.status = "No record length found";
+    return;
+  }
+  uint16_t before = fv.columns;
+  size_t stride = 0;
+  uint32_t width = panelWidth(ctx.focus);
+  bool chosen = resultList("record lengths", guesses.size(), [&](size_t r){
+    StrideGuess& g = guesses[r];
+    printw("%5zu bytes  %5.1f%% same as a row up  score %.2f", g.stride, g.matches*100, g.score);
+  }, [&](size_t r){
+    // records longer than fit in the panel take a few rows each, a divisor
+    // keeps them lined up. The status says how long they are
+    stride = guesses[r].stride;
+    size_t size = viewTypes[fv.type].size;
+    fv.columns = size;
+    for(size_t d = std::min<size_t>(stride, COLUMNS_MAX); d > size; d--){
+      if(stride % d == 0 && d % size == 0 && rowWidth(fv, d) <= width){
+        fv.columns = d;
+        break;
+      }
+    }
+  });
+  if(!chosen) fv.columns = before;
+  else if(stride > fv.columns) ctx.status = "records of " + std::to_string(stride) + " bytes, columns: " + std::to_string(fv.columns);
+  else ctx.status = "columns: " + std::to_string(fv.columns);
+  clearScreen();
+}
+
+// Likely xor keys of the selection, or the whole file. The highlighted key is
+// previewed over the view without touching the buffer, enter keeps the
+// preview on until P
+void xorKeySuggest(){
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  size_t begin = fv.extent > 1 ? std::min(fv.cursor, file.data.size()) : 0;
+  size_t end = fv.extent > 1 ? std::min(fv.cursor + fv.extent, file.data.size()) : file.data.size();
+  std::vector<XorGuess> guesses = guessXorKeys(file.data.source(), begin, end);
+  if(guesses.empty()){
+    ctx.status = "Too few bytes to guess a key from";
+    return;
+  }
+  FileView before = fv;
+  fv.xorOrigin = begin;
+  bool chosen = resultList("xor keys", guesses.size(), [&](size_t r){
+    XorGuess& g = guesses[r];
+    printw("%3zu bytes  score %.3f  ", g.key.size(), g.score);
+    for(char c: g.key) printw("%02x", (uint8_t)c);
+  }, [&](size_t r){
+    fv.xorLength = guesses[r].key.size();
+    memcpy(fv.xorKey, guesses[r].key.data(), fv.xorLength);
+  });
+  if(!chosen) fv = before;
+  else ctx.status = "Previewing the key, X xor applies it, P stops";
+  clearScreen();
+}
+
+// Copied ranges are kept as pieces of storage, which never changes, so a copy
+// costs the same however big it is and stays right after the file it came
+// from is edited. Bytes are only read when pasted ranges are saved or the
+// clipboard is exported
+struct Clipboard{
+  std::vector<Piece> pieces;
+  size_t size = 0;
+} clipboard;
+
+void copySelection(){
+  FileView& fv = panelTree[ctx.focus].file;
+  PieceTable& data = files[fv.i].data;
+  size_t begin = std::min(fv.cursor, data.size());
+  size_t end = std::min(fv.cursor + fv.extent, data.size());
+  clipboard.pieces = data.slice(begin, end-begin);
+  clipboard.size = end-begin;
+  ctx.status = "Copied " + std::to_string(clipboard.size) + " bytes";
+}
+
+// replaces the selection if there is one, inserts at the cursor otherwise
+void paste(){
+  if(clipboard.size == 0){
+    ctx.status = "Clipboard is empty";
+    return;
+  }
+  if(!editable()) return;
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  size_t begin = std::min(fv.cursor, file.data.size());
+  size_t removed = fv.extent > 1 ? std::min(fv.cursor + fv.extent, file.data.size()) - begin : 0;
+  file.splice(begin, removed, clipboard.pieces, clipboard.size);
+  fv.cursor = begin;
+  fv.extent = clipboard.size;
+  ctx.status = "Pasted " + std::to_string(clipboard.size) + " bytes";
+}
+
+// to the system clipboard with whichever tool fits the session, to a file
+// if there's none or it didn't work
+void exportClipboard(){
+  if(clipboard.size == 0){
+    ctx.status = "Clipboard is empty";
+    return;
+  }
+  const char* command = getenv("WAYLAND_DISPLAY") ? "wl-copy 2>/dev/null"
+    : getenv("DISPLAY") ? "xclip -selection clipboard 2>/dev/null" : nullptr;
+  if(command){
+    FILE* out = popen(command, "w");
+    if(out){
+      bool ok = writePieces(clipboard.pieces, out);
+      ok &= pclose(out) == 0;
+      if(ok){
+        ctx.status = "Exported " + std::to_string(clipboard.size) + " bytes to the system clipboard";
+        return;
+      }
+    }
+  }
+  std::string path;
+  if(!promptInput("no system clipboard, export to file: ", path) || path.empty()) return;
+  FILE* out = fopen(path.data(), "wb");
+  bool ok = out && writePieces(clipboard.pieces, out);
+  if(out) ok &= fclose(out) == 0;
+  ctx.status = ok ? "Exported " + std::to_string(clipboard.size) + " bytes to " + path : "Can't write " + path;
+}
+
+// The selection as source code or text, to a file or the system clipboard.
+// It's encoded a chunk at a time straight into the file or pipe
+void exportSelection(std::string_view format, std::string path){
+  const Encoding* encoding = findEncoding(format);
+  if(!encoding){
+    ctx.status = "Expected c, rust, base64 or escaped";
+    return;
+  }
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  size_t begin = std::min(fv.cursor, file.data.size());
+  size_t end = std::min(fv.cursor + fv.extent, file.data.size());
+  std::string name = arrayName(file.name(), encoding->encode == encodeRust);
+  FILE* out;
+  if(path.empty()){
+    const char* command = getenv("WAYLAND_DISPLAY") ? "wl-copy 2>/dev/null"
+      : getenv("DISPLAY") ? "xclip -selection clipboard 2>/dev/null" : nullptr;
+    out = command ? popen(command, "w") : nullptr;
+    if(!out){
+      ctx.status = "No system clipboard, give a path to export to";
+      return;
+    }
+  }
+  else out = fopen(path.data(), "wb");
+  bool ok = out && encodeRange(file.data.source(), begin, end-begin, *encoding, name, out);
+  if(out) ok &= (path.empty() ? pclose(out) : fclose(out)) == 0;
+  std::string to = path.empty() ? "the system clipboard" : path;
+  ctx.status = ok ? "Exported " + std::to_string(end-begin) + " bytes as " + encoding->name + " to " + to : "Can't write to " + to;
+}
+
+// Hex text, or an xxd dump, decoded and put over the selection. Without
+// text it's read from the system clipboard
+void pasteHex(std::string_view text){
+  std::string pasted;
+  if(text.empty()){
+    const char* command = getenv("WAYLAND_DISPLAY") ? "wl-paste -n 2>/dev/null"
+      : getenv("DISPLAY") ? "xclip -selection clipboard -o 2>/dev/null" : nullptr;
+    FILE* in = command ? popen(command, "r") : nullptr;
+    if(!in){
+      ctx.status = "No system clipboard, give the hex after the command";
+      return;
+    }
+    char block[4096];
+    for(size_t n; (n = fread(block, 1, sizeof(block), in)) > 0;) pasted.append(block, n);
+    pclose(in);
+    text = pasted;
+  }
+  std::string bytes;
+  if(!decodeHexText(text, bytes)){
+    ctx.status = "Not hex or an xxd dump";
+    return;
+  }
+  if(!editable()) return;
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  size_t begin = std::min(fv.cursor, file.data.size());
+  size_t removed = fv.extent > 1 ? std::min(fv.cursor + fv.extent, file.data.size()) - begin : 0;
+  file.replace(begin, removed, bytes.data(), bytes.size());
+  fv.cursor = begin;
+  fv.extent = std::max<size_t>(bytes.size(), 1);
+  ctx.status = "Pasted " + std::to_string(bytes.size()) + " bytes of hex";
+}
+
+uint32_t piecesCrc(const std::vector<Piece>& pieces){
+  uint32_t crc = ~0u;
+  for(const Piece& p: pieces) crc = crc32Update(crc, (const uint8_t*)storages[p.storage].data() + p.offset, p.size);
+  return ~crc;
+}
+
+// A patch from the file as it was opened to how it is now. Pieces still in
+// the original storage are reads of the source, everything else is stored
+void makePatch(std::string path){
+  File& file = files[panelTree[ctx.focus].file.i];
+  const std::string& original = storages[file.data.original];
+  BpsWriter writer(original.size(), file.data.size());
+  for(const Piece& p: file.data.pieces){
+    if(p.storage == file.data.original) writer.source(p.offset, p.size);
+    else writer.target(storages[p.storage].data() + p.offset, p.size);
+  }
+  std::string& patch = writer.finish(crc32Of((const uint8_t*)original.data(), original.size()), piecesCrc(file.data.pieces));
+  FILE* out = fopen(path.data(), "wb");
+  bool ok = out && fwrite(patch.data(), 1, patch.size(), out) == patch.size();
+  if(out) ok &= fclose(out) == 0;
+  ctx.status = ok ? "Wrote a " + std::to_string(patch.size()) + " byte patch to " + path : "Can't write " + path;
+}
+
+// The patched file is put together as pieces of the current one and bytes
+// of the patch, then swapped in as one undo entry, so nothing is copied
+void applyPatch(std::string path){
+  if(!editable()) return;
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  MappedFile patch;
+  BpsHeader header;
+  std::string error;
+  if(!patch.open(path.data())){
+    ctx.status = "Can't read " + path;
+    return;
+  }
+  if(!bpsHeader(patch.data, patch.size, header, error)){
+    ctx.status = path + ": " + error;
+    return;
+  }
+  if(header.sourceSize != file.data.size() || header.sourceCrc != piecesCrc(file.data.pieces)){
+    ctx.status = path + " is a patch for another file";
+    return;
+  }
+  PieceTable target;
+  target.add = file.data.add;
+  bool ok = bpsActions(header, [&](const BpsAction& a){
+    if(a.command == BPS_TARGET_READ) target.replace(target.length, 0, (const char*)a.data, a.length);
+    else if(a.command != BPS_TARGET_COPY) target.splice(target.length, 0, file.data.slice(a.offset, a.length));
+    else{
+      // an overlapping copy repeats the bytes between offset and the end,
+      // so whole periods of what's been written can be copied at a time
+      size_t period = a.output - a.offset;
+      for(size_t done = 0; done < a.length;){
+        size_t back = (target.length - a.offset) / period * period;
+        size_t n = std::min(back, a.length - done);
+        target.splice(target.length, 0, target.slice(target.length - back, n));
+        done += n;
+      }
+    }
+    return true;
+  }, error);
+  if(ok && piecesCrc(target.pieces) != header.targetCrc) error = "the patched file came out wrong";
+  if(!error.empty()){
+    ctx.status = path + ": " + error;
+    return;
+  }
+  file.splice(0, file.data.size(), target.pieces, target.length);
+  fv.cursor = std::min(fv.cursor, file.data.size() ? file.data.size()-1 : 0);
+  fv.extent = 1;
+  ctx.status = "Patched to " + std::to_string(target.length) + " bytes";
+}
+
+void undo(bool forward){
+  if(!editable()) return;
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  UndoHistory& h = file.history;
+  if(h.batch){
+    ctx.status = "Can't undo while a macro replays";
+    return;
+  }
+  size_t at = forward ? file.travel(h.redo, h.undo) : file.travel(h.undo, h.redo);
+  if(at == SIZE_MAX){
+    ctx.status = forward ? "Nothing to redo" : "Nothing to undo";
+    return;
+  }
+  fv.cursor = std::min(at, file.data.size());
+  fv.extent = 1;
+  ctx.lowNibble = false;
+}
+
+// "name key" for one of transforms, worked out in the background and then
+// put over the selection as a single undo entry
+void startTransform(std::string_view input){
+  size_t space = input.find(' ');
+  std::string_view name = input.substr(0, space);
+  const Transform* transform = findTransform(name);
+  if(!transform){
+    ctx.status = "Unknown transform " + std::string(name);
+    return;
+  }
+  std::string key;
+  auto stream = std::make_shared<KeyStream>();
+  if(transform->keyed){
+    if(space == std::string_view::npos || !parsePattern(input.substr(space+1), key) || key.size() > TRANSFORM_KEY_MAX){
+      ctx.status = "Expected hex bytes or \"text\" after " + std::string(transform->name);
+      return;
+    }
+    stream->init(key);
+  }
+  if(!editable()) return;
+  FileView& fv = panelTree[ctx.focus].file;
+  size_t file = fv.i;
+  ByteSource source = files[file].data.source();
+  size_t begin = std::min(fv.cursor, source.size);
+  size_t n = std::min(fv.cursor + fv.extent, source.size) - begin;
+  // an undo entry that changes nothing would make the next u look broken
+  if(n == 0){
+    ctx.status = "Nothing selected to transform";
+    return;
+  }
+  auto out = std::make_shared<std::string>(n, 0);
+  startJob(transform->name, n, [=](Job& j){
+    transformRange(source, begin, n, *transform, *stream, out->data(), j.done, j.cancel);
+  }, [=](){
+    files[file].replace(begin, n, out->data(), n);
+    ctx.status = std::string(transform->name) + " over " + std::to_string(n) + " bytes";
+  });
+}
+
+void transformSelection(){
+  std::string input;
+  if(!promptInput("transform (fill/xor/add/sub KEY, bswap16/32/64, bitrev, nibbles): ", input)) return;
+  startTransform(input);
+}
+
+// hex digit typed in edit mode, high nibble first
+void typeNibble(int value){
+  FileView& fv = panelTree[ctx.focus].file;
+  File& file = files[fv.i];
+  bool append = fv.cursor >= file.data.size();
+  uint8_t old = append ? 0 : file.data.at(fv.cursor);
+  uint8_t b = ctx.lowNibble ? (old & 0xf0) | value : value << 4 | (old & 0x0f);
+  file.replace(fv.cursor, append ? 0 : 1, (char*)&b, 1);
+  if(ctx.lowNibble) moveCursor(1);
+  ctx.lowNibble = !ctx.lowNibble;
+}
+
+int hexValue(int ch){
+  if(ch >= '0' && ch <= '9') return ch - '0';
+  if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+void recordMacro(){
+  if(macro.recording){
+    macro.keys.pop_back(); // this Q
+    macro.recording = false;
+    ctx.status = "Recorded " + std::to_string(macro.keys.size()) + " keys";
+    return;
+  }
+  if(replaying()) return;
+  macro.keys.clear();
+  macro.recording = true;
+}
+
+// replays the macro runs times, its edits to each file undo as one
+void replayMacro(size_t runs){
+  if(macro.keys.empty()){
+    ctx.status = "No macro, Q records one";
+    return;
+  }
+  macro.runs = runs;
+  macro.next = macro.played = macro.done = 0;
+  macro.fileCount = files.size();
+  for(size_t f = 0; f < macro.fileCount; f++) files[f].history.beginBatch(files[f].data);
+}
+
+void replayDone(){
+  for(size_t f = 0; f < macro.fileCount; f++) files[f].history.endBatch(files[f].data);
+  macro.fileCount = 0;
+  std::string status = ctx.status;
+  ctx.status = "Macro ran " + std::to_string(macro.done) + " times";
+  if(!status.empty()) ctx.status += ", " + status;
+  ctx.paintGeneration++;
+  clearScreen();
+}
+
+void runMacro(){
+  if(macro.recording){
+    macro.keys.pop_back(); // this @, a macro can't replay itself
+    ctx.status = "Can't replay while recording";
+    return;
+  }
+  std::string input;
+  if(!promptInput("replay how many times (* until a search fails): ", input)) return;
+  size_t runs = 1;
+  if(input == "*") runs = SIZE_MAX;
+  else if(!input.empty() && (!parseNumber(input, runs) || runs == 0)){
+    ctx.status = "Expected a count or *";
+    return;
+  }
+  replayMacro(runs);
+}
+
+// : commands. args[0] is the name as typed, the rest are views into the line
+struct Command{
+  std::vector<std::string_view> names;
+  const char* usage;
+  size_t minArgs, maxArgs;
+  std::function<void(std::vector<std::string_view>& args)> act;
+};
+
+const Command commands[] = {
+  {{"q", "quit"}, "q", 0, 0, [](auto& args){
+    ctx.quit = true;
+  }},
+  {{"c", "columns"}, "columns N", 1, 1, [](auto& args){
+    size_t n;
+    if(!parseNumber(args[1], n) || n == 0 || n > COLUMNS_MAX){
+      ctx.status = "Expected 1 to " + std::to_string(COLUMNS_MAX) + " columns";
+      return;
+    }
+    panelTree[ctx.focus].file.columns = n;
+  }},
+  {{"o", "open"}, "open PATH", 1, 1, [](auto& args){
+    std::string path(args[1]);
+    // opening moves the files around, which a job may be reading
+    if(!editable()) return;
+    // a directory opens as a stream too, but has nothing to read
+    struct stat st;
+    if(stat(path.data(), &st) != 0 || !S_ISREG(st.st_mode) || !std::ifstream(path)){
+      ctx.status = "Can't open " + path;
+      return;
+    }
+    files.push_back(File(path));
+    FileView& fv = panelTree[ctx.focus].file;
+    fv = FileView{.i = files.size()-1};
+  }},
+  {{"w", "write"}, "write [PATH]", 0, 1, [](auto& args){
+    File& file = files[panelTree[ctx.focus].file.i];
+    std::string path = args.size() > 1 ? std::string(args[1]) : file.path;
+    ctx.status = file.data.save(path) ? "Wrote " + path : "Can't write " + path;
+  }},
+  {{"g", "goto"}, "goto OFFSET", 1, 1, [](auto& args){
+    FileView& fv = panelTree[ctx.focus].file;
+    size_t offset;
+    if(!parseNumber(args[1], offset)){
+      ctx.status = "Expected an offset, decimal or 0x hex";
+      return;
+    }
+    size_t size = files[fv.i].data.size();
+    fv.cursor = size ? std::min(offset, size-1) : 0;
+    fv.extent = 1;
+  }},
+  {{"s", "search"}, "search PATTERN", 1, SIZE_MAX, [](auto& args){
+    startSearch(argsFrom(args, 1));
+  }},
+  {{"h", "hash"}, "hash [all]", 0, 1, [](auto& args){
+    if(args.size() > 1 && args[1] != "all"){
+      ctx.status = "Expected all or nothing after hash";
+      return;
+    }
+    startChecksums(args.size() > 1);
+  }},
+  {{"t", "transform"}, "transform NAME [KEY]", 1, SIZE_MAX, [](auto& args){
+    startTransform(argsFrom(args, 1));
+  }},
+  {{"export"}, "export c|rust|base64|escaped [PATH]", 1, 2, [](auto& args){
+    exportSelection(args[1], args.size() > 2 ? std::string(args[2]) : "");
+  }},
+  {{"ph", "pastehex"}, "pastehex [HEX]", 0, SIZE_MAX, [](auto& args){
+    pasteHex(args.size() > 1 ? argsFrom(args, 1) : std::string_view());
+  }},
+  {{"mkpatch"}, "mkpatch PATH", 1, 1, [](auto& args){
+    makePatch(std::string(args[1]));
+  }},
+  {{"patch"}, "patch PATH", 1, 1, [](auto& args){
+    applyPatch(std::string(args[1]));
+  }},
+  {{"u", "undo"}, "undo", 0, 0, [](auto& args){ undo(false); }},
+  {{"redo"}, "redo", 0, 0, [](auto& args){ undo(true); }},
+};
+
+// every name and alias, built once before the first command
+std::unordered_map<std::string_view, const Command*> commandIndex;
+std::vector<std::string_view> commandNames;
+History commandHistory;
+
+void indexCommands(){
+  for(const Command& c: commands){
+    for(std::string_view name: c.names){
+      commandIndex[name] = &c;
+      commandNames.push_back(name);
+    }
+  }
+}
+
+// tab on the last word: a command name first, then a transform or export format
+void completeCommand(std::string& line, size_t& cursor){
+  if(cursor != line.size()) return;
+  size_t start = line.find_last_of(' ') + 1;
+  std::vector<std::string_view> before = splitArgs(std::string_view(line).substr(0, start));
+  std::vector<std::string_view> candidates;
+  if(before.empty()) candidates = commandNames;
+  else if(before.size() == 1 && (before[0] == "t" || before[0] == "transform")){
+    for(const Transform& t: transforms) candidates.push_back(t.name);
+  }
+  else if(before.size() == 1 && before[0] == "export"){
+    for(const Encoding& e: encodings) candidates.push_back(e.name);
+  }
+  std::string word;
+  size_t found = completeWord(std::string_view(line).substr(start), candidates, word);
+  line.replace(start, std::string::npos, word);
+  if(found == 1) line += ' ';
+  cursor = line.size();
+}
+
+void runCommand(std::string_view line){
+  std::vector<std::string_view> args = splitArgs(line);
+  if(args.empty()) return;
+  auto found = commandIndex.find(args[0]);
+  if(found == commandIndex.end()){
+    ctx.status = "No command " + std::string(args[0]);
+    return;
+  }
+  const Command& command = *found->second;
+  if(args.size()-1 < command.minArgs || args.size()-1 > command.maxArgs){
+    ctx.status = std::string("usage: ") + command.usage;
+    return;
+  }
+  command.act(args);
+}
+
+void commandLine(){
+  std::string line;
+  if(promptInput(":", line, &commandHistory, completeCommand)) runCommand(line);
+}
+
+// bench.cpp includes this file for everything above
+#ifndef DEDITOR_NO_MAIN
 int main(int argc, char** argv){
+  if(argc > 1 && strcmp(argv[1], "--dump") == 0) return runDump(argc-2, argv+2);
+  if(argc > 1 && strcmp(argv[1], "--undump") == 0) return runUndump(argc-2, argv+2);
+  if(argc > 1 && strcmp(argv[1], "--mkpatch") == 0) return runMakePatch(argc-2, argv+2);
+  if(argc > 1 && strcmp(argv[1], "--patch") == 0) return runApplyPatch(argc-2, argv+2);
+  if(argc > 1 && strcmp(argv[1], "--script") == 0){
+    if(argc < 4){
+      fprintf(stderr, "usage: %s --script file.ds target...\n", argv[0]);
+      return 2;
+    }
+    return runScript(argv[2], std::vector<std::string>(argv+3, argv+argc));
+  }
+  std::vector<std::string> paths(argv+1, argv+argc);
+  const char* recordPath = nullptr;
+  bool headless = false;
+  if(argc > 1 && strcmp(argv[1], "--record") == 0){
+    if(argc < 3){
+      fprintf(stderr, "usage: %s --record session.log [file...]\n", argv[0]);
+      return 2;
+    }
+    recordPath = argv[2];
+    paths.erase(paths.begin(), paths.begin()+2);
+  }
+  else if(argc > 1 && strcmp(argv[1], "--replay") == 0){
+    const char* logPath = nullptr;
+    bool usage = false;
+    for(int arg = 2; arg < argc; arg++){
+      if(strcmp(argv[arg], "--headless") == 0) headless = true;
+      else if(strcmp(argv[arg], "--timed") == 0) session.timed = true;
+      else if(!logPath) logPath = argv[arg];
+      else usage = true;
+    }
+    std::string error;
+    if(usage || !logPath){
+      fprintf(stderr, "usage: %s --replay [--headless] [--timed] session.log\n", argv[0]);
+      return 2;
+    }
+    if(!session.load(logPath, error)){
+      fprintf(stderr, "%s\n", error.data());
+      return 1;
+    }
+    paths = session.files;
+    session.replay = true;
+  }
+
   ctx.focus = 0;
-  if(argc == 1){
+  if(paths.empty()){
     files.push_back(File());
     panelTree.push_back(Panel{.isSplit = false, .file = {.i = 0}});
   }
-  else if(argc == 2){
-    files.push_back(File(argv[1]));
+  else if(paths.size() == 1){
+    files.push_back(File(paths[0]));
     panelTree.push_back(Panel{.isSplit = false, .file = {.i = 0}});    
   }
   else{
     ctx.focus = 1;
-    for(int arg = 1; arg < argc; arg++){
-    files.push_back(File(argv[1]));
+    for(const std::string& path: paths){
+      files.push_back(File(path));
     }
     panelTree.push_back(Panel{.isSplit = true, .type = 0});
     for(size_t i = 0; i < files.size()-2; i++){
@@ -360,34 +2029,163 @@ int main(int argc, char** argv){
       panelTree.push_back(Panel{.isSplit = false, .file = {.i = files.size()-1}});
   }
 
+  // a clipboard tool that isn't there shouldn't take the editor down with it
+  signal(SIGPIPE, SIG_IGN);
+
   // panelTreePrint(0, 0);
 
   // exit(0);
   
-  initscr();
+  // a headless replay draws to a terminal nobody sees
+  if(headless){
+    const char* term = getenv("TERM") ? getenv("TERM") : "xterm-256color";
+    if(!newterm(term, fopen("/dev/null", "w"), stdin)){
+      fprintf(stderr, "no terminfo for %s\n", term);
+      return 1;
+    }
+  }
+  else initscr();
+  if(session.replay) resize_term(session.rows, session.cols);
+  if(recordPath && !session.startRecording(recordPath, paths, LINES, COLS)){
+    endwin();
+    fprintf(stderr, "can't write %s\n", recordPath);
+    return 1;
+  }
 
   init_colors();
   
   noecho();
   curs_set(0);
   keypad(stdscr, TRUE);
+  set_escdelay(25);
 
-  bool running = true;
-  while(running){
-    clear();
+  indexCommands();
+  while(!ctx.quit){
+    // a replay finishes jobs where the recorded session did, waiting if need be
+    if(job && (session.replay ? session.jobDone() : job->finished.load())) jobDone();
+    if(macro.fileCount > 0 && !replaying()) replayDone();
+    // a replayed macro draws nothing until it's done
+    if(!replaying()){
+      followLinks();
 
-    panelTreeDraw(0, 0, 0, COLS, LINES-1);
-    // move(LINES/2, 0);
+      int bottom = ctx.inspector ? inspectorHeight() : 0;
+      panelTreeDraw(0, 0, 0, COLS, LINES-1-bottom);
+      if(ctx.inspector) inspectorDraw(LINES-1-bottom);
+      move(LINES-1, 0);
+      clrtoeol();
+      if(ctx.editMode) printw("-- EDIT -- ");
+      printw("%s", ctx.status.data());
+      if(panelTree[ctx.focus].file.xorLength > 0) printw("  [xor preview]");
+      if(macro.recording) printw("  [recording]");
+      shownProgress = -1;
+      if(job){
+        if(job->total){
+          shownProgress = session.replay ? std::max(session.progress(), 0) : (int)(job->done*100/job->total);
+          printw("  %s %d%% (esc: cancel)", job->name.data(), shownProgress);
+        }
+        else printw("  %s... (esc: cancel)", job->name.data());
+      }
+      // move(LINES/2, 0);
 
-    int ch = getch();
+      // while a job runs wake up now and then to show how far it got
+      timeout(job ? 100 : -1);
+    }
+    int ch = readKey();
+    // the prompts and lists a key opens wait for their keys however long it takes
+    timeout(-1);
+    if(ch == ERR) continue;
+    ctx.status.clear();
+    switch(ch){
+      case KEY_LEFT: case KEY_RIGHT: case KEY_UP: case KEY_DOWN:
+      case KEY_SLEFT: case KEY_SRIGHT: case KEY_SF: case KEY_SR:
+      case 'n': case 'N': case ']': case '[': break;
+      case KEY_RESIZE: clearScreen(); break;
+      default: ctx.paintGeneration++; break;
+    }
+    if(ctx.editMode && hexValue(ch) >= 0){
+      if(editable()) typeNibble(hexValue(ch));
+      continue;
+    }
+    if(ch == KEY_LEFT || ch == KEY_RIGHT || ch == KEY_UP || ch == KEY_DOWN){
+      ctx.lowNibble = false;
+      panelTree[ctx.focus].file.extent = 1;
+    }
     switch(ch){
       case 'q': {
-        running = false;
+        ctx.quit = true;
       }; break;
-      case KEY_RIGHT: moveCursor(1); break;
-      case KEY_LEFT:  moveCursor(-1); break;
+      case ':': commandLine(); break;
+      case 'Q': recordMacro(); break;
+      case '@': runMacro(); break;
+      case KEY_RIGHT: moveCursor(viewTypes[panelTree[ctx.focus].file.type].size); break;
+      case KEY_LEFT:  moveCursor(-viewTypes[panelTree[ctx.focus].file.type].size); break;
       case KEY_DOWN:  moveCursor(panelTree[ctx.focus].file.columns); break;
       case KEY_UP:    moveCursor(-(int)panelTree[ctx.focus].file.columns); break;
+      case KEY_SRIGHT: growSelection(1); break;
+      case KEY_SLEFT:  growSelection(-1); break;
+      case KEY_SF:     growSelection(panelTree[ctx.focus].file.columns); break; // shift down
+      case KEY_SR:     growSelection(-(long)panelTree[ctx.focus].file.columns); break; // shift up
+      case 'S': statsPanel(); break;
+      case 'R': strideSuggest(); break;
+      case 'y': copySelection(); break;
+      case 'p': paste(); break;
+      case 'Y': exportClipboard(); break;
+      case 'X': transformSelection(); break;
+      case 'K': xorKeySuggest(); break;
+      case 'D': diffStart(); break;
+      case 'L': linkView(); break;
+      case ']': diffJump(true); break;
+      case '[': diffJump(false); break;
+      case 'P': panelTree[ctx.focus].file.xorLength = 0; break;
+      case 'u': undo(false); break;
+      case 'U': undo(true); break;
+      case 'h': startChecksums(false); break;
+      case 'H': startChecksums(true); break;
+      case '/': globalSearch(); break;
+      case 'n': jumpToHit(true); break;
+      case 'N': jumpToHit(false); break;
+      case 'i': {
+        ctx.editMode = true;
+        ctx.lowNibble = false;
+      }; break;
+      case 27: { // esc
+        ctx.editMode = false;
+        if(job) job->cancel = true;
+      }; break;
+      case KEY_IC: { // insert a zero byte
+        if(!editable()) break;
+        FileView& fv = panelTree[ctx.focus].file;
+        char zero = 0;
+        files[fv.i].replace(fv.cursor, 0, &zero, 1);
+      }; break;
+      case KEY_DC: {
+        if(!editable()) break;
+        FileView& fv = panelTree[ctx.focus].file;
+        File& file = files[fv.i];
+        if(fv.cursor < file.data.size()) file.replace(fv.cursor, 1, "", 0);
+        if(fv.cursor >= file.data.size() && fv.cursor > 0) fv.cursor--;
+      }; break;
+      case 'W': {
+        File& file = files[panelTree[ctx.focus].file.i];
+        ctx.status = file.data.save(file.path) ? "Wrote " + file.path : "Can't write " + file.path;
+      }; break;
+      case '?': regexSearch(); break;
+      case 's': stringsSearch(); break;
+      case 'c': carveScan(); break;
+      case 't':
+      case 'T': {
+        File& file = files[panelTree[ctx.focus].file.i];
+        if((ch == 'T' || !file.layout) && !loadTemplate(file)) break;
+        templateBrowse();
+      }; break;
+      case 'I': ctx.inspector = !ctx.inspector; break;
+      case 'm':
+      case 'E': {
+        FileView& fv = panelTree[ctx.focus].file;
+        if(ch == 'm') fv.type = (fv.type+1) % viewTypeCount;
+        else fv.bigEndian = !fv.bigEndian;
+        ctx.status = std::string("view: ") + viewTypes[fv.type].name + (fv.bigEndian ? " big endian" : " little endian");
+      }; break;
       case 'w': {
         bool running = true;
         while(running){
@@ -395,8 +2193,8 @@ int main(int argc, char** argv){
           move(LINES-panelTree.size()-1, 0);
           panelTreePrint(0, 2);
 
-          int ch = getch();
-          clear();
+          int ch = readKey();
+          clearScreen();
           switch(ch){
             case 'q':
             case 27: { // esc
@@ -490,9 +2288,23 @@ int main(int argc, char** argv){
       }; break;
     }
   }
+  if(job){
+    job->cancel = true;
+    job->thread.join();
+  }
+  // a session that quit has its last frame still on the screen
+  if(session.replay) captureScreen();
   endwin();
+  if(session.record) fclose(session.record);
+  // the screen is all a replay prints to stdout
+  if(session.replay){
+    fwrite(replayScreen.data(), 1, replayScreen.size(), stdout);
+    session.report(stderr);
+    return 0;
+  }
   printf("Focus: %zu\n", ctx.focus);
   for(auto& s: panelTree){
     printf("%d\n", s.isSplit);
   }
 }
+#endif